@@ -24,7 +24,11 @@ int create_index(const std::string& output, int universe)
         stdin_graph graph;
         options opts(universe);
         Index index(opts, output.c_str());
-        graph_serializer<stdin_graph, Index> serializer(graph, index);
+
+        if (configuration::get().indices_build_segments)
+            segmented_graph_serializer<stdin_graph, Index> serializer(graph, index, output);
+        else
+            graph_serializer<stdin_graph, Index> serializer(graph, index);
     }
     else
     {
@@ -77,6 +81,7 @@ int main(int argc, char *argv[])
         return create_index<BOOST_PP_CAT(T, _index)>(output, universe);
 
     BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SIMPLE_INDEX_TYPES);
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_COVERAGE_INDEX_TYPES);
 #undef LOOP_BODY
 #define LOOP_BODY(R, DATA, T)                         \
     } else if (index_type == BOOST_PP_STRINGIZE(T)) { \
@@ -147,6 +147,20 @@ private:
     Index& m_friends;
 };
 
+template <typename Index>
+void report_cache(const Index& index, size_t queries)
+{}
+
+template <typename Sequence>
+void report_cache(const cached_index<Sequence>& index, size_t queries)
+{
+    files::block_cache::stats stats = index.cache().totals();
+
+    logger() << index
+             << " bytes-read/query=" << (queries ? stats.bytes_read / queries : 0)
+             << std::endl;
+}
+
 template <typename Index>
 void friends_at_k(const char* input_fname,
                   int k,
@@ -169,6 +183,8 @@ void friends_at_k(const char* input_fname,
 
     extractor.complete();
     plog.done();
+
+    report_cache(index, plog.items);
 }
 
 int main(int argc, char *argv[])
@@ -196,6 +212,7 @@ int main(int argc, char *argv[])
         );
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_INDEX_TYPES);
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_CACHED_INDEX_TYPES);
 #undef LOOP_BODY
     } else {
         std::cerr << "ERROR: Unknown index_type " << index_type << std::endl;
@@ -1,3 +1,5 @@
+#include <array>
+#include <map>
 #include "ps/optargs.hpp"
 #include "ps/utils.hpp"
 #include "ps/indices/index_types.hpp"
@@ -5,6 +7,48 @@
 using namespace ps;
 using namespace ps::indices;
 
+template <typename Index>
+void print_codec_mix(const Index& index, std::false_type)
+{}
+
+// Lists and elements per codec, grouped by degree class [2^k, 2^(k+1))
+template <typename Index>
+void print_codec_mix(const Index& index, std::true_type)
+{
+    typedef sequences::hybrid_seq hybrid_seq;
+    std::map<uint64_t, std::array<std::pair<uint64_t, uint64_t>, hybrid_seq::num_codecs>> mix;
+
+    for (uint64_t docid = 0; docid < index.num_docs(); ++docid)
+    {
+        uint64_t offset;
+        if (!index.get_offset(docid, offset))
+            continue;
+
+        auto en = index.sequence_at(offset);
+        uint64_t cls = 0;
+        while ((2ULL << cls) <= en.size())
+            ++cls;
+
+        auto& bucket = mix[cls][en.codec()];
+        bucket.first++;
+        bucket.second += en.size();
+    }
+
+    for (auto& cls : mix)
+    {
+        for (uint8_t tag = 0; tag < hybrid_seq::num_codecs; ++tag)
+        {
+            if (cls.second[tag].first == 0)
+                continue;
+
+            std::cout << "degree=[" << (1ULL << cls.first) << "," << (2ULL << cls.first) << ")"
+                      << " codec=" << hybrid_seq::codec_name(tag)
+                      << " lists=" << cls.second[tag].first
+                      << " elements=" << cls.second[tag].second << std::endl;
+        }
+    }
+}
+
 int main(int argc, char *argv[])
 {
     PARSE_ARGUMENTS(
@@ -20,7 +64,10 @@ int main(int argc, char *argv[])
 #define LOOP_BODY(R, DATA, T)                                   \
     } else if (index_type == BOOST_PP_STRINGIZE(T)) {              \
         BOOST_PP_CAT(T, _index) index(input_idx.c_str()); \
-        std::cout << index << std::endl;
+        std::cout << index << std::endl;                                  \
+        print_codec_mix(index, std::is_same<                             \
+            BOOST_PP_CAT(T, _index)::sequence_type,                      \
+            sequences::hybrid_seq>());
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_INDEX_TYPES);
 #undef LOOP_BODY
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/utility.hpp>
+#include "ps/files.hpp"
+
+namespace ps {
+namespace files {
+
+// Sharded CLOCK cache over the fixed-size chunks of a random_access_file.
+// Chunk k holds the bytes [k * chunk_bytes, (k + 1) * chunk_bytes), is
+// cache-line aligned and followed by zeroed padding, so decoders that read
+// a few words past the end of a list stay inside the buffer.
+//
+// Chunks are handed out as shared pointers: one evicted while a reader still
+// uses it lives on until the reader drops it. Misses are read without
+// holding the shard lock.
+class block_cache : boost::noncopyable {
+public:
+    static const size_t padding = 64;
+
+    struct chunk {
+        chunk(size_t size)
+            : size(size)
+        {
+            void* p = nullptr;
+            if (posix_memalign(&p, 64, size + padding) != 0)
+                throw std::bad_alloc();
+            data = static_cast<char*>(p);
+            memset(data + size, 0, padding);
+        }
+
+        ~chunk()
+        {
+            free(data);
+        }
+
+        char* data;
+        size_t size;
+    };
+
+    typedef std::shared_ptr<const chunk> chunk_ptr;
+
+    struct stats {
+        stats()
+            : hits(0)
+            , misses(0)
+            , bytes_read(0)
+        {}
+
+        double hit_ratio() const
+        {
+            return (hits + misses) ? (double)hits / (hits + misses) : 0;
+        }
+
+        stats operator-(const stats& other) const
+        {
+            stats diff;
+            diff.hits = hits - other.hits;
+            diff.misses = misses - other.misses;
+            diff.bytes_read = bytes_read - other.bytes_read;
+            return diff;
+        }
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t bytes_read;
+    };
+
+    block_cache(std::unique_ptr<random_access_file> file,
+                uint64_t file_size,
+                uint64_t capacity_bytes,
+                uint64_t chunk_bytes,
+                size_t num_shards)
+        : m_file(std::move(file))
+        , m_file_size(file_size)
+        , m_chunk_bytes(chunk_bytes)
+        , m_shards(num_shards ? num_shards : 1)
+        , m_hits(0)
+        , m_misses(0)
+        , m_bytes_read(0)
+    {
+        size_t slots = capacity_bytes / chunk_bytes / m_shards.size();
+        for (auto& shard : m_shards)
+            shard.slots.resize(slots ? slots : 1);
+    }
+
+    uint64_t chunk_bytes() const
+    {
+        return m_chunk_bytes;
+    }
+
+    chunk_ptr get(uint64_t k)
+    {
+        shard& s = m_shards[k % m_shards.size()];
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.index.find(k);
+            if (it != s.index.end()) {
+                slot& hit = s.slots[it->second];
+                hit.referenced = true;
+                count(true, 0);
+                return hit.data;
+            }
+        }
+
+        chunk_ptr loaded = load(k);
+        count(false, loaded->size);
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(k);
+        if (it != s.index.end()) // another reader got there first
+            return s.slots[it->second].data;
+
+        // the clock hand clears reference bits until it finds a victim
+        for (;;) {
+            slot& victim = s.slots[s.hand];
+            if (victim.data && victim.referenced) {
+                victim.referenced = false;
+                s.hand = (s.hand + 1) % s.slots.size();
+                continue;
+            }
+
+            if (victim.data)
+                s.index.erase(victim.key);
+
+            victim.key = k;
+            victim.data = loaded;
+            victim.referenced = true;
+            s.index[k] = s.hand;
+            s.hand = (s.hand + 1) % s.slots.size();
+            return loaded;
+        }
+    }
+
+    // Copies [offset, offset + n) to out, chunk by chunk
+    void read(uint64_t offset, size_t n, char* out)
+    {
+        while (n) {
+            uint64_t k = offset / m_chunk_bytes;
+            uint64_t in_chunk = offset - k * m_chunk_bytes;
+            chunk_ptr c = get(k);
+
+            size_t len = std::min<uint64_t>(n, c->size - in_chunk);
+            memcpy(out, c->data + in_chunk, len);
+            out += len;
+            offset += len;
+            n -= len;
+        }
+    }
+
+    stats totals() const
+    {
+        stats s;
+        s.hits = m_hits;
+        s.misses = m_misses;
+        s.bytes_read = m_bytes_read;
+        return s;
+    }
+
+    // Counters of the calling thread over every cache, a query can take the
+    // difference of two snapshots
+    static stats& thread_stats()
+    {
+        static thread_local stats s;
+        return s;
+    }
+
+private:
+    struct slot {
+        slot()
+            : key(0)
+            , referenced(false)
+        {}
+
+        uint64_t key;
+        chunk_ptr data;
+        bool referenced;
+    };
+
+    struct shard {
+        shard()
+            : hand(0)
+        {}
+
+        std::mutex mutex;
+        std::unordered_map<uint64_t, size_t> index;
+        std::vector<slot> slots;
+        size_t hand;
+    };
+
+    chunk_ptr load(uint64_t k)
+    {
+        uint64_t begin = k * m_chunk_bytes;
+        size_t size = std::min<uint64_t>(m_chunk_bytes, m_file_size - begin);
+        std::shared_ptr<chunk> c(new chunk(size));
+
+        std::string result;
+        if (!m_file->read(begin, size, &result, c->data) || result.size() != size)
+            throw std::runtime_error("Error reading chunk");
+
+        return c;
+    }
+
+    void count(bool hit, uint64_t bytes)
+    {
+        stats& local = thread_stats();
+        if (hit) {
+            m_hits++;
+            local.hits++;
+        } else {
+            m_misses++;
+            local.misses++;
+            m_bytes_read += bytes;
+            local.bytes_read += bytes;
+        }
+    }
+
+    std::unique_ptr<random_access_file> m_file;
+    uint64_t m_file_size;
+    uint64_t m_chunk_bytes;
+    std::vector<shard> m_shards;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_bytes_read;
+};
+
+}
+}
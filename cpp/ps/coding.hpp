@@ -36,6 +36,18 @@ inline uint64_t decode_fixed_64(const char* ptr)
 #endif
 }
 
+inline void encode_fixed_32(char* buf, uint32_t value)
+{
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+  memcpy(buf, &value, sizeof(value));
+#else
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+  buf[2] = (value >> 16) & 0xff;
+  buf[3] = (value >> 24) & 0xff;
+#endif
+}
+
 inline void encode_fixed_64(char* buf, uint64_t value)
 {
 #if __BYTE_ORDER == __LITTLE_ENDIAN
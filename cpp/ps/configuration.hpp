@@ -1,5 +1,11 @@
 #pragma once
 
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <boost/lexical_cast.hpp>
+
 namespace ps {
 
 class configuration {
@@ -21,6 +27,24 @@ public:
     int indices_topk_threshold;
     int indices_topk_rmq_wand_threshold;
     size_t indices_topk_rmq_sizehint;
+    bool indices_lazy_nodes;
+    size_t indices_build_segments;
+    size_t indices_cache_bytes;
+    size_t indices_cache_chunk_bytes;
+    size_t indices_cache_shards;
+    double indices_coverage_budget;
+
+    size_t sequences_reference_window;
+    size_t sequences_reference_chain;
+
+    std::string files_mmap_policy;
+    size_t files_mmap_warmup_threads;
+
+    size_t engine_batch_slice;
+
+    size_t solvers_parallel_threads;
+    size_t solvers_parallel_degree;
+    double solvers_parallel_work;
 
 private:
     configuration()
@@ -34,6 +58,28 @@ private:
         fillvar("PS_INDICES_TOPK_THRESHOLD", indices_topk_threshold, 10);
         fillvar("PS_INDICES_TOPK_RMQ_WAND_THRESHOLD", indices_topk_rmq_wand_threshold, 1000);
         fillvar("PS_INDICES_TOPK_RMQ_SIZEHINT", indices_topk_rmq_sizehint, 1 << 20);
+        fillvar("PS_INDICES_LAZY_NODES", indices_lazy_nodes, false);
+        fillvar("PS_INDICES_BUILD_SEGMENTS", indices_build_segments, 0);
+        fillvar("PS_INDICES_CACHE_BYTES", indices_cache_bytes, 1ULL << 30);
+        fillvar("PS_INDICES_CACHE_CHUNK_BYTES", indices_cache_chunk_bytes, 1 << 16);
+        fillvar("PS_INDICES_CACHE_SHARDS", indices_cache_shards, 16);
+        fillvar("PS_INDICES_COVERAGE_BUDGET", indices_coverage_budget, 1.0);
+
+        // Sequences specific configurations
+        fillvar("PS_SEQUENCES_REFERENCE_WINDOW", sequences_reference_window, 7);
+        fillvar("PS_SEQUENCES_REFERENCE_CHAIN", sequences_reference_chain, 3);
+
+        // Files specific configurations
+        fillvar("PS_FILES_MMAP_POLICY", files_mmap_policy, "");
+        fillvar("PS_FILES_MMAP_WARMUP_THREADS", files_mmap_warmup_threads, 4);
+
+        // Engine specific configurations
+        fillvar("PS_ENGINE_BATCH_SLICE", engine_batch_slice, 16);
+
+        // Solvers specific configurations
+        fillvar("PS_SOLVERS_PARALLEL_THREADS", solvers_parallel_threads, std::thread::hardware_concurrency());
+        fillvar("PS_SOLVERS_PARALLEL_DEGREE", solvers_parallel_degree, 1024);
+        fillvar("PS_SOLVERS_PARALLEL_WORK", solvers_parallel_work, 1 << 20);
     }
 
     template <typename T, typename T2>
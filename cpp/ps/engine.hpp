@@ -0,0 +1,691 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/utility.hpp>
+#include <boost/preprocessor/seq/for_each.hpp>
+#include <boost/preprocessor/stringize.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include "ps/configuration.hpp"
+#include "ps/mapping.hpp"
+#include "ps/utils.hpp"
+#include "ps/dicts/dict_types.hpp"
+#include "ps/indices/index_types.hpp"
+#include "ps/problems/schemes.hpp"
+#include "ps/problems/intersection.hpp"
+#include "ps/problems/topk.hpp"
+#include "ps/problems/planner.hpp"
+
+namespace ps {
+
+// In-process query API. An engine opens an index, a dictionary and the
+// optional ranking data once and answers (user, prefix, scheme, k) queries,
+// alone on the calling thread or in batches on a pool of worker threads.
+//
+// Every worker owns the scratch space of its queries (result vectors,
+// solvers, remapping buffers), and hands each result to the callback by
+// reference: the result is only valid during the call.
+class engine : boost::noncopyable {
+public:
+    struct config {
+        config()
+            : threads(configuration::get().worker_threads)
+            , plan(false)
+        {}
+
+        std::string index_type;
+        std::string index;
+        std::string dict_type;
+        std::string dictionary;
+        std::string id_mapping;     // optional, user ids are sort ids without it
+        std::string dict_remapping; // needed by the baseline schemes
+        std::string ranking;        // needed by the topk schemes
+        std::string wand;
+        size_t threads;
+        bool plan;                  // let the planner pick the scheme of each query
+    };
+
+    struct query {
+        query()
+            : user(0)
+            , scheme(problems::Scheme::Hopping)
+            , k(0)
+        {}
+
+        query(uint64_t user, const std::string& prefix, problems::Scheme scheme, int k = 0)
+            : user(user)
+            , prefix(prefix)
+            , scheme(scheme)
+            , k(k)
+        {}
+
+        uint64_t user;
+        std::string prefix;
+        problems::Scheme scheme;
+        int k;                      // 0 for every result, in docid order
+    };
+
+    struct result {
+        problems::Scheme scheme;    // the scheme that answered
+        int l;
+        int r;
+        std::vector<uint64_t> docids;
+        uint64_t prefix_search_nsec;
+        uint64_t solve_nsec;
+        std::string error;          // set if the query could not be answered
+    };
+
+    // Called with the position of the query in its batch
+    typedef std::function<void(size_t, const query&, const result&)> callback;
+
+    engine()
+        : m_slice(configuration::get().engine_batch_slice)
+        , m_shutdown(false)
+    {}
+
+    virtual ~engine()
+    {
+        stop();
+    }
+
+    static std::unique_ptr<engine> open(const config& cfg);
+
+    template <typename Index>
+    static std::unique_ptr<engine> open(const config& cfg);
+
+    size_t threads() const
+    {
+        return m_workers.size();
+    }
+
+    // Answers one query on the calling thread
+    virtual void execute(const query& q, result& out) = 0;
+
+    // The estimates of the planner for a query and the scheme it picks
+    virtual std::string explain(const query& q) = 0;
+
+    // Times every scheme that answers the problem of each query of sample
+    // and fits the cost model of the planner to them. Not to be called
+    // while queries are running.
+    virtual void calibrate(const std::vector<query>& sample) = 0;
+
+    // Queues a batch for the workers and returns. Callbacks run on the
+    // workers, done (if any) once every query has been answered.
+    void submit(std::shared_ptr<const std::vector<query>> batch,
+                callback cb,
+                std::function<void()> done = nullptr)
+    {
+        if (m_workers.empty()) {
+            result out;
+            for (size_t i = 0; i < batch->size(); ++i) {
+                execute((*batch)[i], out);
+                cb(i, (*batch)[i], out);
+            }
+            if (done)
+                done();
+            return;
+        }
+
+        std::shared_ptr<batch_state> state(new batch_state());
+        state->queries = batch;
+        state->cb = std::move(cb);
+        state->done = std::move(done);
+        state->remaining = batch->size();
+
+        if (batch->empty()) {
+            if (state->done)
+                state->done();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t begin = 0; begin < batch->size(); begin += m_slice)
+                m_tasks.push_back(task{state, begin, std::min(begin + m_slice, batch->size())});
+        }
+        m_work_cond.notify_all();
+    }
+
+    // Runs a batch on the workers and waits for it
+    void run(const std::vector<query>& batch, callback cb)
+    {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool finished = false;
+
+        std::shared_ptr<const std::vector<query>> shared(&batch, [](const std::vector<query>*) {});
+        submit(shared, std::move(cb), [&]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+            cond.notify_all();
+        });
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!finished)
+            cond.wait(lock);
+    }
+
+protected:
+    // Workers call the virtual functions below, so the derived class starts
+    // them once it is constructed and stops them before it is destroyed
+    void start(size_t threads)
+    {
+        for (size_t i = 0; i < threads; ++i)
+            m_workers.emplace_back(&engine::thread_func, this);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_shutdown = true;
+        }
+        m_work_cond.notify_all();
+
+        for (auto& t : m_workers)
+            t.join();
+        m_workers.clear();
+    }
+
+    // Per worker state, created by the worker itself
+    struct scratch {
+        virtual ~scratch()
+        {}
+
+        result out;
+    };
+
+    virtual std::unique_ptr<scratch> new_scratch() = 0;
+    virtual void execute(const query& q, scratch& s) = 0;
+    virtual void prefix_range(const std::string& prefix, int& l, int& r) const = 0;
+
+public:
+    // Type-ahead for one user: the prefixes typed one after the other.
+    //
+    // Every answered prefix is kept on a small stack. A prefix extending the
+    // one on top of the stack narrows its result to the new dictionary range
+    // instead of solving the query again, since the range of the longer
+    // prefix lies inside the range of the shorter one. Backspace pops back
+    // to the state of the shorter prefix. A topk result can only be narrowed
+    // when it was not cut at k.
+    //
+    // A session uses scratch of its own and runs on the calling thread; the
+    // result is valid until the next call.
+    class session : boost::noncopyable {
+    public:
+        session(engine& e, uint64_t user, problems::Scheme scheme, int k = 0,
+                size_t max_depth = 32)
+            : m_engine(e)
+            , m_query(user, "", scheme, k)
+            , m_scratch(e.new_scratch())
+            , m_max_depth(max_depth ? max_depth : 1)
+            , m_solved(0)
+            , m_narrowed(0)
+        {}
+
+        const result& type(const std::string& prefix)
+        {
+            while (!m_states.empty() &&
+                   prefix.compare(0, m_states.back().prefix.size(), m_states.back().prefix) != 0)
+                m_states.pop_back();
+
+            if (!m_states.empty() && m_states.back().prefix == prefix)
+                return m_states.back().res;
+
+            state next;
+            next.prefix = prefix;
+            if (m_states.empty() || !m_states.back().complete || !narrow(m_states.back(), next)) {
+                m_query.prefix = prefix;
+                m_engine.execute(m_query, *m_scratch);
+                next.res = m_scratch->out;
+                m_solved++;
+            } else {
+                m_narrowed++;
+            }
+
+            next.complete = next.res.error.empty() &&
+                (!is_topk() || next.res.docids.size() < size_t(m_query.k));
+
+            m_states.push_back(std::move(next));
+            if (m_states.size() > m_max_depth)
+                m_states.pop_front();
+
+            return m_states.back().res;
+        }
+
+        void reset()
+        {
+            m_states.clear();
+        }
+
+        size_t depth() const
+        {
+            return m_states.size();
+        }
+
+        uint64_t solved() const
+        {
+            return m_solved;
+        }
+
+        uint64_t narrowed() const
+        {
+            return m_narrowed;
+        }
+
+    private:
+        struct state {
+            std::string prefix;
+            result res;
+            bool complete;
+        };
+
+        bool is_topk() const
+        {
+            return m_query.scheme >= problems::Scheme::TopkHopping;
+        }
+
+        bool narrow(const state& prev, state& next)
+        {
+            namespace bc = boost::chrono;
+            result& out = next.res;
+
+            bc::high_resolution_clock::time_point t_start = bc::high_resolution_clock::now();
+            m_engine.prefix_range(next.prefix, out.l, out.r);
+            out.prefix_search_nsec = bc::duration_cast<bc::nanoseconds>(
+                bc::high_resolution_clock::now() - t_start).count();
+            out.solve_nsec = 0;
+
+            if (out.l == -1)
+                return true;
+            if (prev.res.l == -1 || out.l < prev.res.l || out.r > prev.res.r)
+                return false;
+
+            t_start = bc::high_resolution_clock::now();
+            const std::vector<uint64_t>& docids = prev.res.docids;
+            if (is_topk()) { // ranking order
+                for (uint64_t docid : docids)
+                    if (docid >= uint64_t(out.l) && docid < uint64_t(out.r))
+                        out.docids.push_back(docid);
+            } else {
+                out.docids.assign(std::lower_bound(docids.begin(), docids.end(), uint64_t(out.l)),
+                                  std::lower_bound(docids.begin(), docids.end(), uint64_t(out.r)));
+            }
+            out.solve_nsec = bc::duration_cast<bc::nanoseconds>(
+                bc::high_resolution_clock::now() - t_start).count();
+
+            return true;
+        }
+
+        engine& m_engine;
+        query m_query;
+        std::unique_ptr<scratch> m_scratch;
+        std::deque<state> m_states;
+        size_t m_max_depth;
+        uint64_t m_solved;
+        uint64_t m_narrowed;
+    };
+
+private:
+    struct batch_state {
+        std::shared_ptr<const std::vector<query>> queries;
+        callback cb;
+        std::function<void()> done;
+        std::atomic<size_t> remaining;
+    };
+
+    struct task {
+        std::shared_ptr<batch_state> batch;
+        size_t begin;
+        size_t end;
+    };
+
+    void thread_func()
+    {
+        std::unique_ptr<scratch> s;
+
+        for (;;) {
+            task t;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                while (m_tasks.empty() && !m_shutdown)
+                    m_work_cond.wait(lock);
+                if (m_tasks.empty())
+                    return;
+
+                t = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            if (!s)
+                s = new_scratch();
+
+            const std::vector<query>& queries = *t.batch->queries;
+            for (size_t i = t.begin; i < t.end; ++i) {
+                execute(queries[i], *s);
+                t.batch->cb(i, queries[i], s->out);
+            }
+
+            if (t.batch->remaining.fetch_sub(t.end - t.begin) == t.end - t.begin && t.batch->done)
+                t.batch->done();
+        }
+    }
+
+    size_t m_slice;
+    std::vector<std::thread> m_workers;
+    std::deque<task> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_work_cond;
+    bool m_shutdown;
+};
+
+template <typename Index, typename DictType>
+class basic_engine : public engine {
+public:
+    basic_engine(const engine::config& cfg)
+        : m_index(cfg.index.c_str())
+        , m_dictionary(cfg.dictionary.c_str())
+        , m_ranking(m_index.opts().universe)
+        , m_wand(m_index.opts().universe)
+        , m_planner(m_index, !cfg.dict_remapping.empty(), !cfg.wand.empty())
+        , m_plan(cfg.plan)
+    {
+        if (!cfg.id_mapping.empty())
+            m_uid_to_sid.reset(new mapping::UserIdToSortId(cfg.id_mapping.c_str()));
+        if (!cfg.dict_remapping.empty() && !util::read_vector_from(cfg.dict_remapping, m_remapping))
+            throw std::runtime_error("Unable to load dict remapping");
+        if (!cfg.ranking.empty() && !util::read_ranking_from(cfg.ranking, m_ranking))
+            throw std::runtime_error("Unable to load ranking");
+        if (!cfg.wand.empty() && !util::read_ranking_from(cfg.wand, m_wand))
+            throw std::runtime_error("Unable to load WAND data");
+
+        start(cfg.threads);
+    }
+
+    ~basic_engine()
+    {
+        stop();
+    }
+
+    virtual void execute(const query& q, result& out)
+    {
+        std::unique_ptr<engine::scratch> s = new_scratch();
+        execute(q, *s);
+        out = std::move(s->out);
+    }
+
+    virtual std::string explain(const query& q)
+    {
+        int l, r, sort_id;
+        std::string error;
+        if (!resolve(q, l, r, sort_id, error))
+            return error + "\n";
+
+        std::ostringstream os;
+        m_planner.make_plan(q.scheme, sort_id, l, r, q.k).explain(os);
+        return os.str();
+    }
+
+    virtual void calibrate(const std::vector<query>& sample)
+    {
+        namespace bc = boost::chrono;
+        using namespace problems;
+
+        scratch s(*this);
+        std::vector<typename planner<Index>::sample> samples;
+
+        for (auto const& q : sample) {
+            int l, r, sort_id;
+            std::string error;
+            if (!resolve(q, l, r, sort_id, error))
+                continue;
+
+            Problem problem = problem_of(q.scheme);
+            query_stats stats = m_planner.stats(q.scheme, sort_id, l, r, q.k);
+
+            for (size_t i = 0; i < num_schemes; ++i) {
+                Scheme scheme = Scheme(i);
+                if (!m_planner.applicable(scheme, problem))
+                    continue;
+
+                s.out.l = l;
+                s.out.r = r;
+                s.out.docids.clear();
+
+                bc::high_resolution_clock::time_point t_start = bc::high_resolution_clock::now();
+                try {
+                    solve(scheme, q.k, sort_id, s);
+                } catch (const std::exception&) {
+                    continue;
+                }
+                double nsec = bc::duration_cast<bc::nanoseconds>(
+                    bc::high_resolution_clock::now() - t_start).count();
+
+                samples.push_back({scheme, stats, nsec});
+            }
+        }
+
+        m_planner.calibrate(samples);
+    }
+
+protected:
+    template <problems::Scheme Method>
+    using topk_solver = problems::topk::solver<Index, Method>;
+
+    struct scratch : engine::scratch {
+        scratch(const basic_engine& e)
+            : hopping(e.m_index, e.m_ranking, e.m_wand, 0)
+            , hopping_wand(e.m_index, e.m_ranking, e.m_wand, 0)
+            , hopping_rmq(e.m_index, e.m_ranking, e.m_wand, 0)
+            , hopping_rmq_wand(e.m_index, e.m_ranking, e.m_wand, 0)
+        {}
+
+        topk_solver<problems::Schemes::topk_hopping> hopping;
+        topk_solver<problems::Schemes::topk_hopping_wand> hopping_wand;
+        topk_solver<problems::Schemes::topk_hopping_rmq> hopping_rmq;
+        topk_solver<problems::Schemes::topk_hopping_rmq_wand> hopping_rmq_wand;
+        std::vector<uint64_t> remapping;
+    };
+
+    virtual std::unique_ptr<engine::scratch> new_scratch()
+    {
+        return std::unique_ptr<engine::scratch>(new scratch(*this));
+    }
+
+    virtual void execute(const query& q, engine::scratch& base)
+    {
+        namespace bc = boost::chrono;
+        using namespace problems;
+
+        scratch& s = static_cast<scratch&>(base);
+        result& out = s.out;
+        out.scheme = q.scheme;
+        out.docids.clear();
+        out.error.clear();
+        out.prefix_search_nsec = out.solve_nsec = 0;
+
+        bc::high_resolution_clock::time_point t_start = bc::high_resolution_clock::now();
+        prefix_range(q.prefix, out.l, out.r);
+        out.prefix_search_nsec = bc::duration_cast<bc::nanoseconds>(
+            bc::high_resolution_clock::now() - t_start).count();
+
+        int sort_id = q.user;
+        if (m_uid_to_sid && !m_uid_to_sid->get(q.user, sort_id)) {
+            out.error = "Unknown user";
+            return;
+        }
+
+        if (out.l == -1)
+            return;
+
+        t_start = bc::high_resolution_clock::now();
+        try {
+            if (m_plan)
+                out.scheme = m_planner.choose(q.scheme, sort_id, out.l, out.r, q.k);
+            solve(out.scheme, q.k, sort_id, s);
+        } catch (const std::exception& e) {
+            out.docids.clear();
+            out.error = e.what();
+        }
+        out.solve_nsec = bc::duration_cast<bc::nanoseconds>(
+            bc::high_resolution_clock::now() - t_start).count();
+    }
+
+    // Range and sort id of a query, false with the reason if there is
+    // nothing to solve
+    bool resolve(const query& q, int& l, int& r, int& sort_id, std::string& error) const
+    {
+        prefix_range(q.prefix, l, r);
+
+        sort_id = q.user;
+        if (m_uid_to_sid && !m_uid_to_sid->get(q.user, sort_id)) {
+            error = "Unknown user";
+            return false;
+        }
+        if (l == -1) {
+            error = "No match for the prefix";
+            return false;
+        }
+        return true;
+    }
+
+    virtual void prefix_range(const std::string& prefix, int& l, int& r) const
+    {
+        auto range = m_dictionary.prefix_search(prefix);
+        l = range.first;
+        r = range.second;
+    }
+
+    void solve(problems::Scheme scheme, int k, uint64_t sort_id, scratch& s)
+    {
+        using namespace problems;
+        int l = s.out.l, r = s.out.r;
+        std::vector<uint64_t>& docids = s.out.docids;
+
+        switch (scheme) {
+        case AsIndex:
+            intersection::solver<Index, Schemes::asindex>(m_index).solve(sort_id, l, r, docids);
+            break;
+        case Hopping:
+            intersection::solver<Index, Schemes::hopping>(m_index).solve(sort_id, l, r, docids);
+            break;
+        case Coverage:
+            intersection::solver<Index, Schemes::coverage>(m_index).solve(sort_id, l, r, docids);
+            break;
+        case BaselineHopping:
+            intersection::solver<Index, Schemes::baseline_hopping>(m_index).solve_baseline_hopping(
+                sort_id, sorted_remapping(l, r, s), docids);
+            break;
+        case BaselineAsIndex:
+            intersection::solver<Index, Schemes::baseline_asindex>(m_index).solve_baseline_asindex(
+                sort_id, sorted_remapping(l, r, s), docids);
+            break;
+        case FastBaselineHopping:
+            check_remapping();
+            intersection::solver<Index, Schemes::fast_baseline_hopping>(m_index).solve_fast_baseline_hopping(
+                sort_id, l, r, m_remapping, docids);
+            break;
+        case FastBaselineAsIndex:
+            check_remapping();
+            intersection::solver<Index, Schemes::fast_baseline_asindex>(m_index).solve_fast_baseline_asindex(
+                sort_id, l, r, m_remapping, docids);
+            break;
+        case TopkHopping:
+            solve_topk(s.hopping, k, sort_id, l, r, docids);
+            break;
+        case TopkHoppingWAND:
+            solve_topk(s.hopping_wand, k, sort_id, l, r, docids);
+            break;
+        case TopkHoppingRMQ:
+            solve_topk(s.hopping_rmq, k, sort_id, l, r, docids);
+            break;
+        case TopkHoppingRMQWAND:
+            solve_topk(s.hopping_rmq_wand, k, sort_id, l, r, docids);
+            break;
+        default:
+            throw std::runtime_error("Unknown scheme");
+        }
+    }
+
+    template <typename Solver>
+    void solve_topk(Solver& solver, int k, uint64_t sort_id, int l, int r,
+                    std::vector<uint64_t>& docids)
+    {
+        if (k <= 0)
+            throw std::runtime_error("Topk schemes need k > 0");
+
+        uint64_t offset;
+        if (!m_index.get_offset(sort_id, offset))
+            return;
+
+        solver.set_k(k);
+        docids.resize(k);
+        solver.solve(sort_id, l, r, docids);
+    }
+
+    // The baseline schemes want the ids of [l, r) sorted, and consume them
+    std::vector<uint64_t>& sorted_remapping(int l, int r, scratch& s)
+    {
+        check_remapping();
+        s.remapping.assign(m_remapping.begin() + l, m_remapping.begin() + r);
+        std::sort(s.remapping.begin(), s.remapping.end());
+        return s.remapping;
+    }
+
+    void check_remapping() const
+    {
+        if (m_remapping.empty())
+            throw std::runtime_error("Baseline schemes need a dict remapping");
+    }
+
+    Index m_index;
+    DictType m_dictionary;
+    std::unique_ptr<mapping::UserIdToSortId> m_uid_to_sid;
+    std::vector<uint64_t> m_remapping;
+    std::vector<uint64_t> m_ranking;
+    std::vector<uint64_t> m_wand;
+    problems::planner<Index> m_planner;
+    bool m_plan;
+};
+
+template <typename Index>
+std::unique_ptr<engine> engine::open(const config& cfg)
+{
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                      \
+    } else if (cfg.dict_type == BOOST_PP_STRINGIZE(T)) {                           \
+        return std::unique_ptr<engine>(                                            \
+            new basic_engine<Index, dicts::BOOST_PP_CAT(T, _dict)>(cfg));
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_DICT_TYPES);
+#undef LOOP_BODY
+    }
+
+    throw std::runtime_error("Unknown dict_type " + cfg.dict_type);
+}
+
+inline std::unique_ptr<engine> engine::open(const config& cfg)
+{
+    if (false) {
+#define LOOP_BODY(R, DATA, T)                                                      \
+    } else if (cfg.index_type == BOOST_PP_STRINGIZE(T)) {                          \
+        return open<indices::BOOST_PP_CAT(T, _index)>(cfg);
+
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_INDEX_TYPES);
+#undef LOOP_BODY
+    }
+
+    throw std::runtime_error("Unknown index_type " + cfg.index_type);
+}
+
+}
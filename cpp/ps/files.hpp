@@ -10,6 +10,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include "ps/utils.hpp"
+#include "ps/configuration.hpp"
 
 #ifndef __linux__
 #define POSIX_FADV_NORMAL 0 /* [MC1] no further special treatment */
@@ -330,5 +336,145 @@ bool new_random_access_file(const std::string& fname,
     return s;
 }
 
+// Paging policy of a read-only mapping, set with PS_FILES_MMAP_POLICY:
+//
+//   [flags][;suffix=flags]...
+//
+// flags is a comma separated list of normal, random, sequential or willneed
+// (the madvise() access pattern), hugepages (MADV_HUGEPAGE), mlock and
+// prefault. The entry with the longest suffix matching the file name is
+// used, the entry without a suffix covers the other files. For instance
+//
+//   random;.off=willneed,mlock;.deg=willneed,mlock;.pos=random,prefault
+//
+// keeps the node directory locked in memory and faults the postings in
+// before the first query.
+struct mapping_policy {
+    mapping_policy()
+        : advice(random_access_file::NORMAL)
+        , hugepages(false)
+        , lock(false)
+        , prefault(false)
+    {}
+
+    static mapping_policy parse(const std::string& flags)
+    {
+        mapping_policy policy;
+        std::vector<std::string> tokens;
+        boost::split(tokens, flags, boost::is_any_of(","));
+
+        for (auto& token : tokens) {
+            boost::trim(token);
+            if (token.empty())
+                continue;
+            else if (token == "normal")
+                policy.advice = random_access_file::NORMAL;
+            else if (token == "random")
+                policy.advice = random_access_file::RANDOM;
+            else if (token == "sequential")
+                policy.advice = random_access_file::SEQUENTIAL;
+            else if (token == "willneed")
+                policy.advice = random_access_file::WILLNEED;
+            else if (token == "hugepages")
+                policy.hugepages = true;
+            else if (token == "mlock")
+                policy.lock = true;
+            else if (token == "prefault")
+                policy.prefault = true;
+            else
+                throw std::runtime_error("Unknown mmap policy flag " + token);
+        }
+
+        return policy;
+    }
+
+    static mapping_policy for_file(const std::string& filename,
+                                   const std::string& spec = configuration::get().files_mmap_policy)
+    {
+        std::vector<std::string> entries;
+        boost::split(entries, spec, boost::is_any_of(";"));
+
+        std::string flags;
+        size_t best = 0;
+        for (auto const& entry : entries) {
+            size_t eq = entry.find('=');
+            if (eq == std::string::npos) {
+                if (!best)
+                    flags = entry;
+                continue;
+            }
+
+            std::string suffix = boost::trim_copy(entry.substr(0, eq));
+            if (suffix.size() > best && boost::ends_with(filename, suffix)) {
+                flags = entry.substr(eq + 1);
+                best = suffix.size();
+            }
+        }
+
+        return parse(flags);
+    }
+
+    random_access_file::AccessPattern advice;
+    bool hugepages;
+    bool lock;
+    bool prefault;
+};
+
+// Applies the policy to a mapping, logging the time spent when it asked for
+// any warm-up. Failures only cost performance, so they are logged and
+// otherwise ignored.
+inline void apply_mapping_policy(const std::string& filename,
+                                 const char* data, size_t size,
+                                 const mapping_policy& policy,
+                                 size_t threads = configuration::get().files_mmap_warmup_threads)
+{
+    if (!size)
+        return;
+
+    void* addr = const_cast<char*>(data);
+    boost::posix_time::ptime tick = boost::posix_time::microsec_clock::universal_time();
+
+    static const int advice[] = {
+        MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL, MADV_WILLNEED, MADV_DONTNEED
+    };
+    if (madvise(addr, size, advice[policy.advice]) != 0)
+        logger() << "madvise() failed on " << filename << ": " << strerror(errno) << std::endl;
+
+#ifdef MADV_HUGEPAGE
+    if (policy.hugepages && madvise(addr, size, MADV_HUGEPAGE) != 0)
+        logger() << "MADV_HUGEPAGE failed on " << filename << ": " << strerror(errno) << std::endl;
+#endif
+
+    if (!policy.prefault && !policy.lock)
+        return;
+
+    if (policy.prefault) {
+        // every thread touches one byte per page of its share of the file
+        const size_t page = sysconf(_SC_PAGESIZE);
+        size_t pages = (size + page - 1) / page;
+        threads = std::max<size_t>(1, std::min(threads, pages));
+
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < threads; ++t) {
+            workers.emplace_back([=]() {
+                volatile char sink = 0;
+                for (size_t p = pages * t / threads; p < pages * (t + 1) / threads; ++p)
+                    sink += data[p * page];
+                (void)sink;
+            });
+        }
+
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    if (policy.lock && mlock(data, size) != 0)
+        logger() << "mlock() failed on " << filename << ": " << strerror(errno) << std::endl;
+
+    uint64_t elapsed = (boost::posix_time::microsec_clock::universal_time() - tick).total_milliseconds();
+    logger() << "Warmed up " << filename << " (" << size << " bytes"
+             << (policy.lock ? ", locked" : "") << ") in " << elapsed << " ms" << std::endl;
+}
+
 }
 }
@@ -1,15 +1,28 @@
 #pragma once
 
+#include <exception>
+#include <deque>
+#include <thread>
 #include "ps/queues.hpp"
+#include "ps/configuration.hpp"
 #include "ps/sequences/options.hpp"
 #include "ps/graphs/graph_types.hpp"
+#include "ps/indices/builders/segment.hpp"
 
 namespace ps {
 namespace graphs {
 
+// Nodes are submitted to the queue in chunks of up to chunk_nodes nodes or
+// chunk_edges edges. A chunk copies its adjacency lists into one array,
+// encodes them back to back into one string and is appended to the postings
+// with a single write, so there are a few allocations per chunk rather than
+// per node.
 template<typename GraphType, typename Index>
 class graph_serializer {
 public:
+    static const size_t chunk_nodes = 1024;
+    static const size_t chunk_edges = 1 << 18;
+
     graph_serializer(GraphType& graph, Index& index)
         : m_builder(index)
         , m_opts(index.opts())
@@ -21,56 +34,246 @@ public:
         queues::ordered_queue q;
 
         Edges edges;
+        std::shared_ptr<chunk_write_job> chunk(new chunk_write_job(*this));
 
         while (iterator.get_next(edges))
         {
-            std::shared_ptr<edges_write_job> jobptr(
-                new edges_write_job(*this, edges)
-            );
-            q.add_job(jobptr, 1);
+            chunk->add(edges);
+            if (chunk->num_nodes() >= chunk_nodes || chunk->num_edges() >= chunk_edges) {
+                q.add_job(chunk, chunk->num_nodes());
+                chunk.reset(new chunk_write_job(*this));
+            }
 
             plog.done_item();
             written++;
         }
 
+        if (chunk->num_nodes())
+            q.add_job(chunk, chunk->num_nodes());
+
         q.complete();
         m_builder.commit();
 
         plog.done();
     }
 private:
-    struct edges_write_job : queues::job {
-        edges_write_job(graph_serializer& parent, Edges edges)
+    struct chunk_write_job : queues::job {
+        chunk_write_job(graph_serializer& parent)
             : m_serializer(parent)
-            , m_edges(edges)
         {}
 
+        void add(const Edges& edges)
+        {
+            m_docids.push_back(edges.first);
+            m_sizes.push_back(edges.second.size());
+            m_edges.insert(m_edges.end(), edges.second.begin(), edges.second.end());
+        }
+
+        size_t num_nodes() const
+        {
+            return m_docids.size();
+        }
+
+        size_t num_edges() const
+        {
+            return m_edges.size();
+        }
+
         virtual void prepare(void* user_data)
         {
-            // XX: for options() use const reference instead of copy
-            Index::sequence_type::serialize(
-                m_value,
-                m_serializer.m_opts,
-                m_edges.second.size(), m_edges.second.begin()
-            );
+            std::string encoded;
+            std::vector<int>::const_iterator begin = m_edges.begin();
+
+            m_ends.reserve(m_sizes.size());
+            for (auto n : m_sizes) {
+                Index::sequence_type::serialize(encoded, m_serializer.m_opts, n, begin);
+                m_encoded.append(encoded);
+                m_ends.push_back(m_encoded.size());
+                begin += n;
+            }
+
+            std::vector<int>().swap(m_edges);
         }
 
         virtual void commit(void* user_data)
         {
-            m_serializer.m_builder.append(
-                m_edges.first, m_value, m_edges.second.size()
-            );
+            m_serializer.m_builder.append_batch(m_docids, m_sizes, m_encoded, m_ends);
         }
 
         graph_serializer& m_serializer;
-        Edges m_edges;
-        std::string m_value;
+        std::vector<uint64_t> m_docids;
+        std::vector<uint64_t> m_sizes;
+        std::vector<int> m_edges;       // adjacency lists back to back
+        std::string m_encoded;          // their encodings back to back
+        std::vector<uint64_t> m_ends;
     };
 
     typename Index::builder m_builder;
     sequences::options m_opts;
 };
 
+// Builds the index as num_segments independent segments over equal docid
+// ranges (see indices::segment). The nodes of a range are buffered while the
+// graph is read and then serialized and written by a thread of their own,
+// with up to worker_threads segments in flight. Once the graph is over the
+// segments are stitched into the index files by the index builder, which
+// copies the postings and rebases the offsets.
+//
+// Segments completed by an interrupted build are reused: their nodes are
+// skipped while reading and their files are stitched as they are.
+template<typename GraphType, typename Index>
+class segmented_graph_serializer {
+public:
+    typedef indices::segment<typename Index::sequence_type> segment_type;
+
+    segmented_graph_serializer(GraphType& graph, Index& index,
+                               const std::string& filename,
+                               uint64_t num_segments = configuration::get().indices_build_segments)
+        : m_builder(index)
+        , m_opts(index.opts())
+        , m_filename(filename)
+        , m_num_segments(num_segments ? num_segments : 1)
+        , m_span((m_opts.universe + m_num_segments - 1) / m_num_segments)
+        , m_max_in_flight(configuration::get().worker_threads)
+        , m_reused(0)
+    {
+        if (!m_span)
+            m_span = 1;
+
+        for (uint64_t k = 0; k < m_num_segments; ++k) {
+            if (segment_type::complete(segment_prefix(k))) {
+                logger() << "Reusing segment " << k << std::endl;
+                m_reused++;
+            }
+        }
+
+        progress_logger plog("friends");
+        edges_iterator<GraphType> iterator(graph);
+
+        uint64_t current = 0;
+        bool skip = segment_type::complete(segment_prefix(0));
+        std::shared_ptr<std::vector<Edges>> nodes(new std::vector<Edges>());
+        Edges edges;
+
+        try {
+            while (iterator.get_next(edges))
+            {
+                uint64_t k = edges.first / m_span;
+                assert(k >= current && k < m_num_segments);
+
+                while (current < k) {
+                    if (!skip)
+                        flush(current, nodes);
+                    nodes.reset(new std::vector<Edges>());
+                    skip = segment_type::complete(segment_prefix(++current));
+                }
+
+                if (!skip)
+                    nodes->push_back(std::move(edges));
+
+                plog.done_item();
+            }
+
+            for (; current < m_num_segments; ++current) {
+                if (!segment_type::complete(segment_prefix(current)))
+                    flush(current, nodes);
+                nodes.reset(new std::vector<Edges>());
+            }
+
+            while (!m_in_flight.empty())
+                join_oldest();
+        } catch (...) {
+            // let the running segments finish, so that they are reused
+            while (!m_in_flight.empty()) {
+                try { join_oldest(); } catch (...) {}
+            }
+            throw;
+        }
+
+        for (uint64_t k = 0; k < m_num_segments; ++k) {
+            segment_type seg(segment_prefix(k));
+            m_builder.append_segment(seg);
+        }
+
+        m_builder.commit();
+
+        for (uint64_t k = 0; k < m_num_segments; ++k)
+            segment_type::remove(segment_prefix(k));
+
+        plog.done();
+    }
+
+    uint64_t reused_segments() const
+    {
+        return m_reused;
+    }
+
+private:
+    struct in_flight {
+        std::thread thread;
+        std::exception_ptr error;
+    };
+
+    std::string segment_prefix(uint64_t k) const
+    {
+        return m_filename + ".seg" + std::to_string(k);
+    }
+
+    void flush(uint64_t k, std::shared_ptr<std::vector<Edges>> nodes)
+    {
+        if (!m_max_in_flight) { // all in main thread
+            build_segment(k, *nodes);
+            return;
+        }
+
+        if (m_in_flight.size() >= m_max_in_flight)
+            join_oldest();
+
+        m_in_flight.emplace_back(new in_flight());
+        in_flight* job = m_in_flight.back().get();
+        job->thread = std::thread([this, k, nodes, job]() {
+            try {
+                build_segment(k, *nodes);
+            } catch (...) {
+                job->error = std::current_exception();
+            }
+        });
+    }
+
+    void join_oldest()
+    {
+        std::unique_ptr<in_flight> job(std::move(m_in_flight.front()));
+        m_in_flight.pop_front();
+
+        job->thread.join();
+        if (job->error)
+            std::rethrow_exception(job->error);
+    }
+
+    void build_segment(uint64_t k, const std::vector<Edges>& nodes)
+    {
+        segment_type seg(m_opts, segment_prefix(k));
+        typename segment_type::builder builder(seg);
+        std::string encoded;
+
+        for (auto const& node : nodes) {
+            Index::sequence_type::serialize(encoded, m_opts,
+                                            node.second.size(), node.second.begin());
+            builder.append(node.first, encoded, node.second.size());
+        }
+
+        builder.commit();
+    }
+
+    typename Index::builder m_builder;
+    sequences::options m_opts;
+    std::string m_filename;
+    uint64_t m_num_segments;
+    uint64_t m_span;
+    uint64_t m_max_in_flight;
+    uint64_t m_reused;
+    std::deque<std::unique_ptr<in_flight>> m_in_flight;
+};
 
 }
 }
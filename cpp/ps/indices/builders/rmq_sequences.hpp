@@ -4,6 +4,7 @@
 #include "succinct/mapper.hpp"
 #include "ps/indices/simple_index.hpp"
 #include "ps/configuration.hpp"
+#include "ps/files.hpp"
 #include "succinct/mapper.hpp"
 #include "succinct/topk_vector.hpp"
 #include "succinct/elias_fano_compressed_list.hpp"
@@ -55,6 +56,9 @@ public:
         const char *data = m_cartesian_trees_file.data();
         const char *eof = data + m_cartesian_trees_file.size() / sizeof(data[0]);
 
+        files::apply_mapping_policy(m_filename, data, eof - data,
+                                    files::mapping_policy::for_file(m_filename));
+
         while (data < eof) {
             m_cartesian_trees.push_back(new succinct::cartesian_tree());
             size_t bytes_read = succinct::mapper::map(*m_cartesian_trees.back(), data);
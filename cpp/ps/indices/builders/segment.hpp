@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include "ps/coding.hpp"
+#include "ps/files.hpp"
+#include "ps/sequences/options.hpp"
+#include "ps/sequences/sequence_file.hpp"
+
+namespace ps {
+namespace indices {
+
+// A docid range of an index written on its own:
+//
+//   <prefix>.pos    postings, a regular sequence_file with its footer
+//   <prefix>.nodes  docid, offset and number of elements of every list,
+//                   fixed 64 bits each
+//
+// The node table is written under a temporary name and renamed once the
+// postings are committed, so a segment whose .nodes file exists is complete
+// and can be reused by a later build.
+template <typename Sequence>
+class segment {
+public:
+    typedef sequences::sequence_file<Sequence> file_type;
+
+    struct node {
+        uint64_t docid;
+        uint64_t offset;
+        uint64_t num_elements;
+    };
+
+    // Opens a complete segment
+    segment(const std::string& prefix)
+        : m_prefix(prefix)
+        , m_postings(prefix.c_str(), ".pos")
+    {
+        boost::iostreams::mapped_file_source table((prefix + ".nodes").c_str());
+        if (!table.is_open())
+            throw std::runtime_error("Error opening segment node table");
+
+        const char* p = table.data();
+        m_nodes.resize(table.size() / (3 * sizeof(uint64_t)));
+        for (auto& n : m_nodes) {
+            n.docid = coding::decode_fixed_64(p);
+            n.offset = coding::decode_fixed_64(p + 8);
+            n.num_elements = coding::decode_fixed_64(p + 16);
+            p += 24;
+        }
+    }
+
+    // Starts a new segment
+    segment(sequences::options opts, const std::string& prefix)
+        : m_prefix(prefix)
+        , m_postings(opts, prefix.c_str(), ".pos")
+    {}
+
+    class builder {
+    public:
+        builder(segment& seg)
+            : m_segment(seg)
+            , m_postings_builder(seg.m_postings)
+        {}
+
+        void append(uint64_t docid, const std::string& encoded, uint64_t num_elements)
+        {
+            uint64_t offset = m_postings_builder.append(encoded, num_elements);
+
+            coding::put_fixed_64(m_table, docid);
+            coding::put_fixed_64(m_table, offset);
+            coding::put_fixed_64(m_table, num_elements);
+        }
+
+        void commit()
+        {
+            m_postings_builder.commit();
+
+            std::string tmp = m_segment.m_prefix + ".nodes.tmp";
+            std::unique_ptr<files::writable_file> table;
+            if (!files::new_writable_file(tmp, &table) || !table->append(m_table) ||
+                !table->sync() || !table->close())
+                throw std::runtime_error("Unable to write segment node table");
+
+            if (std::rename(tmp.c_str(), (m_segment.m_prefix + ".nodes").c_str()) != 0)
+                throw std::runtime_error("Unable to complete segment");
+        }
+
+    private:
+        segment& m_segment;
+        typename file_type::builder m_postings_builder;
+        std::string m_table;
+    };
+
+    static bool complete(const std::string& prefix)
+    {
+        uint64_t size;
+        return files::get_file_size(prefix + ".nodes", &size);
+    }
+
+    static void remove(const std::string& prefix)
+    {
+        std::remove((prefix + ".nodes").c_str());
+        std::remove((prefix + ".nodes.tmp").c_str());
+        std::remove((prefix + ".pos").c_str());
+    }
+
+    const file_type& postings() const
+    {
+        return m_postings;
+    }
+
+    const std::vector<node>& nodes() const
+    {
+        return m_nodes;
+    }
+
+private:
+    std::string m_prefix;
+    file_type m_postings;
+    std::vector<node> m_nodes;
+};
+
+}
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <iostream>
+#include "ps/block_cache.hpp"
+#include "ps/configuration.hpp"
+#include "ps/files.hpp"
+#include "ps/sequences/sequence_file.hpp"
+#include "ps/indices/node_directory.hpp"
+
+namespace ps {
+namespace indices {
+
+// Read side of a simple_index for postings that do not fit in memory. The
+// node directory (.off/.deg) is materialized and stays in RAM, while the
+// postings are read with pread through a block_cache instead of being
+// mmapped, so the cache rather than the kernel decides what stays resident.
+//
+// An enumerator keeps the bytes of its list alive: the cached chunk when the
+// list fits in one, a private copy otherwise.
+template <typename Sequence>
+class cached_index
+{
+public:
+    typedef Sequence sequence_type;
+    typedef sequences::sequence_file<Sequence> file_type;
+    typedef sequences::sequence_file<sequences::ef_seq> nodes_file_type;
+
+    class enumerator : public Sequence::enumerator {
+    private:
+        friend class cached_index;
+
+        struct pin {
+            pin(files::block_cache::chunk_ptr chunk, sequences::options opts)
+                : chunk(chunk)
+                , seq(chunk->data, chunk->size + files::block_cache::padding, opts)
+            {}
+
+            pin(std::unique_ptr<files::block_cache::chunk> copy, sequences::options opts)
+                : copy(std::move(copy))
+                , seq(this->copy->data, this->copy->size + files::block_cache::padding, opts)
+            {}
+
+            files::block_cache::chunk_ptr chunk;
+            std::unique_ptr<files::block_cache::chunk> copy;
+            Sequence seq;
+        };
+
+        enumerator(std::shared_ptr<pin> p, uint64_t offset)
+            : Sequence::enumerator(p->seq.deserialize_at(offset))
+            , m_pin(p)
+        {}
+
+        std::shared_ptr<pin> m_pin;
+    };
+
+    cached_index(const char* filename,
+                 uint64_t cache_bytes = configuration::get().indices_cache_bytes)
+        : m_seq_offsets(filename, ".off")
+        , m_seq_degrees(filename, ".deg")
+        , m_opts(0)
+    {
+        if (!sequences::self_contained<Sequence>::value)
+            throw std::runtime_error("Sequences refer to each other, they can only be mmapped");
+
+        m_nodes.materialize(m_seq_offsets, m_seq_degrees);
+
+        std::string postings(filename);
+        postings.append(".pos");
+
+        uint64_t file_size;
+        std::unique_ptr<files::random_access_file> file;
+        if (!files::get_file_size(postings, &file_size) ||
+            !files::new_random_access_file(postings, &file))
+            throw std::runtime_error("Error opening sequence file");
+
+        std::string footer;
+        std::vector<char> scratch(file_type::footer_size());
+        if (!file->read(file_size - file_type::footer_size(), file_type::footer_size(),
+                        &footer, scratch.data()))
+            throw std::runtime_error("Error reading sequence file footer");
+
+        file_type::read_footer(footer.data(), m_opts, m_num_sequences, m_num_elements,
+                               m_construction_time_microsec);
+        m_contents_size = file_size - file_type::footer_size();
+
+        m_cache.reset(new files::block_cache(std::move(file), m_contents_size, cache_bytes,
+                                             configuration::get().indices_cache_chunk_bytes,
+                                             configuration::get().indices_cache_shards));
+    }
+
+    bool get_offset(uint64_t docid, uint64_t& offset) const
+    {
+        offset = m_nodes.offset(docid);
+        return degree(docid) > 0;
+    }
+
+    uint64_t degree(uint64_t docid) const
+    {
+        return m_nodes.degree(docid);
+    }
+
+    enumerator sequence_at(uint64_t offset) const
+    {
+        uint64_t end = end_of(offset);
+        uint64_t chunk_bytes = m_cache->chunk_bytes();
+        uint64_t k = offset / chunk_bytes;
+        typedef typename enumerator::pin pin;
+
+        if (end <= (k + 1) * chunk_bytes) {
+            std::shared_ptr<pin> p(new pin(m_cache->get(k), m_opts));
+            return enumerator(p, offset - k * chunk_bytes);
+        }
+
+        std::unique_ptr<files::block_cache::chunk> copy(new files::block_cache::chunk(end - offset));
+        m_cache->read(offset, end - offset, copy->data);
+        std::shared_ptr<pin> p(new pin(std::move(copy), m_opts));
+        return enumerator(p, 0);
+    }
+
+    uint64_t num_docs() const
+    {
+        return m_nodes.size();
+    }
+
+    const node_directory& nodes() const
+    {
+        return m_nodes;
+    }
+
+    uint64_t num_elements() const
+    {
+        return m_num_elements;
+    }
+
+    uint64_t construction_time_microsec() const
+    {
+        return m_construction_time_microsec;
+    }
+
+    sequences::options opts() const
+    {
+        return m_opts;
+    }
+
+    files::block_cache& cache() const
+    {
+        return *m_cache;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const cached_index& index)
+    {
+        files::block_cache::stats stats = index.m_cache->totals();
+
+        os << "docs=" << index.num_docs()
+           << " elements=" << index.num_elements()
+           << " postings-bytes=" << index.m_contents_size
+           << " cache-hits=" << stats.hits
+           << " cache-misses=" << stats.misses
+           << " hit-ratio=" << stats.hit_ratio()
+           << " bytes-read=" << stats.bytes_read;
+
+        return os;
+    }
+
+private:
+    // Lists are written in docid order, so a list ends where the first node
+    // with a larger offset starts
+    uint64_t end_of(uint64_t offset) const
+    {
+        uint64_t lo = 0, hi = m_nodes.size();
+        while (lo < hi) {
+            uint64_t mid = (lo + hi) / 2;
+            if (m_nodes.offset(mid) <= offset)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        return (lo < m_nodes.size()) ? m_nodes.offset(lo) : m_contents_size;
+    }
+
+    node_directory m_nodes;
+    nodes_file_type m_seq_offsets;
+    nodes_file_type m_seq_degrees;
+
+    sequences::options m_opts;
+    uint64_t m_num_sequences;
+    uint64_t m_num_elements;
+    uint64_t m_construction_time_microsec;
+    uint64_t m_contents_size;
+
+    std::unique_ptr<files::block_cache> m_cache;
+};
+
+}
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <iostream>
+#include "ps/configuration.hpp"
+#include "ps/utils.hpp"
+#include "ps/indices/simple_index.hpp"
+#include "ps/indices/neighbors.hpp"
+
+namespace ps {
+namespace indices {
+
+// A simple_index plus the materialized friends of friends (N2) of the users
+// that are the most expensive to hop, so that the coverage scheme answers
+// them with a single range scan instead of one per friend.
+//
+// The cost of hopping a user is the sum of the degrees of its friends (and
+// its own). Once the N1 lists are committed the builder ranks the users by
+// that cost and materializes their N2 lists, most expensive first, until
+// they take budget times the bytes of the N1 postings (see
+// PS_INDICES_COVERAGE_BUDGET). The N2 lists are a second simple_index in the
+// .n2.pos/.n2.off/.n2.deg files, empty for the users left out.
+template <typename Sequence>
+class coverage_index : public simple_index<Sequence>
+{
+public:
+    typedef simple_index<Sequence> base_type;
+    typedef Sequence sequence_type;
+
+    coverage_index(const char* filename,
+                   bool lazy_nodes = configuration::get().indices_lazy_nodes)
+        : base_type(filename, lazy_nodes)
+        , m_coverage((std::string(filename) + ".n2").c_str(), lazy_nodes)
+        , m_budget(0)
+    {}
+
+    coverage_index(sequences::options opts, const char* filename,
+                   double budget = configuration::get().indices_coverage_budget)
+        : base_type(opts, filename)
+        , m_coverage(opts, (std::string(filename) + ".n2").c_str())
+        , m_budget(budget)
+    {}
+
+    class builder : public base_type::builder {
+    public:
+        builder(coverage_index& file)
+            : base_type::builder(file)
+            , m_index(file)
+        {}
+
+        void commit()
+        {
+            base_type::builder::commit();
+            build_coverage();
+        }
+
+    private:
+        void build_coverage()
+        {
+            const base_type& index = m_index;
+            uint64_t num_docs = index.num_docs();
+            uint64_t budget = uint64_t(m_index.m_budget * index.postings_bytes());
+
+            std::vector<std::pair<uint64_t, uint64_t>> costs;
+            std::vector<uint64_t> friends;
+
+            for (uint64_t docid = 0; docid < num_docs; ++docid) {
+                uint64_t offset;
+                if (!index.get_offset(docid, offset))
+                    continue;
+
+                friends.clear();
+                fill_vector(index.sequence_at(offset), friends);
+
+                uint64_t cost = friends.size();
+                for (auto f : friends)
+                    cost += index.degree(f);
+
+                costs.emplace_back(cost, docid);
+            }
+
+            std::sort(costs.begin(), costs.end(),
+                      [](const std::pair<uint64_t, uint64_t>& a,
+                         const std::pair<uint64_t, uint64_t>& b) {
+                          return a.first > b.first || (a.first == b.first && a.second < b.second);
+                      });
+
+            // Lists are encoded by cost but appended by docid
+            std::map<uint64_t, std::pair<std::string, uint64_t>> lists;
+            std::vector<uint64_t> n2;
+            std::string encoded;
+            uint64_t used = 0;
+
+            for (auto const& c : costs) {
+                uint64_t offset;
+                index.get_offset(c.second, offset);
+
+                n2.clear();
+                fill_vector(index.sequence_at(offset), n2);
+                for (size_t i = 0, n = n2.size(); i < n; ++i) {
+                    uint64_t f_offset;
+                    if (index.get_offset(n2[i], f_offset))
+                        fill_vector(index.sequence_at(f_offset), n2);
+                }
+
+                std::sort(n2.begin(), n2.end());
+                n2.erase(std::unique(n2.begin(), n2.end()), n2.end());
+                n2.erase(std::remove(n2.begin(), n2.end(), c.second), n2.end());
+
+                if (n2.empty())
+                    continue;
+
+                Sequence::serialize(encoded, index.opts(), n2.size(), n2.begin());
+                if (used + encoded.size() > budget)
+                    break;
+
+                used += encoded.size();
+                lists[c.second] = std::make_pair(encoded, n2.size());
+            }
+
+            typename base_type::builder coverage_builder(m_index.m_coverage);
+            for (auto& l : lists)
+                coverage_builder.append(l.first, l.second.first, l.second.second);
+            coverage_builder.commit();
+
+            logger() << "Materialized N2 of " << lists.size() << " users out of "
+                     << costs.size() << " in " << used << " bytes" << std::endl;
+        }
+
+        coverage_index& m_index;
+    };
+
+    // Offset of the materialized N2 list of docid, false if it has none
+    bool get_coverage_offset(uint64_t docid, uint64_t& offset) const
+    {
+        return docid < m_coverage.num_docs() && m_coverage.get_offset(docid, offset);
+    }
+
+    typename Sequence::enumerator coverage_at(uint64_t offset) const
+    {
+        return m_coverage.sequence_at(offset);
+    }
+
+    const base_type& coverage() const
+    {
+        return m_coverage;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const coverage_index& index)
+    {
+        os << static_cast<const base_type&>(index)
+           << " n2-elements=" << index.m_coverage.num_elements()
+           << " n2-postings-bytes=" << index.m_coverage.postings_bytes();
+
+        return os;
+    }
+
+private:
+    base_type m_coverage;
+    double m_budget;
+};
+
+}
+}
@@ -7,6 +7,8 @@
 
 #include "ps/indices/simple_index.hpp"
 #include "ps/indices/topk_index.hpp"
+#include "ps/indices/coverage_index.hpp"
+#include "ps/indices/cached_index.hpp"
 #include "ps/sequences/sequence_types.hpp"
 
 // I know this is crazy but please don't cry
@@ -16,7 +18,9 @@ namespace indices {
 
 #define LOOP_BODY(R, DATA, T)                                                                  \
     typedef simple_index<BOOST_PP_CAT(sequences::T, _seq)> BOOST_PP_CAT(T, _simple_index);     \
-    typedef topk_index<BOOST_PP_CAT(sequences::T, _seq)> BOOST_PP_CAT(T, _topk_index);
+    typedef topk_index<BOOST_PP_CAT(sequences::T, _seq)> BOOST_PP_CAT(T, _topk_index);        \
+    typedef coverage_index<BOOST_PP_CAT(sequences::T, _seq)> BOOST_PP_CAT(T, _coverage_index); \
+    typedef cached_index<BOOST_PP_CAT(sequences::T, _seq)> BOOST_PP_CAT(T, _cached_index);
 
 BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SEQ_TYPES);
 #undef LOOP_BODY
@@ -30,4 +34,11 @@ BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SEQ_TYPES);
 #define OP_TOPK(S, _, ELEM) BOOST_PP_CAT(ELEM, _topk)
 #define PS_TOPK_INDEX_TYPES BOOST_PP_SEQ_TRANSFORM(OP_TOPK, 0, PS_SEQ_TYPES)
 
-#define PS_INDEX_TYPES PS_SIMPLE_INDEX_TYPES PS_TOPK_INDEX_TYPES
+#define OP_COVERAGE(S, _, ELEM) BOOST_PP_CAT(ELEM, _coverage)
+#define PS_COVERAGE_INDEX_TYPES BOOST_PP_SEQ_TRANSFORM(OP_COVERAGE, 0, PS_SEQ_TYPES)
+
+// Read-only, postings through a block cache instead of mmap
+#define OP_CACHED(S, _, ELEM) BOOST_PP_CAT(ELEM, _cached)
+#define PS_CACHED_INDEX_TYPES BOOST_PP_SEQ_TRANSFORM(OP_CACHED, 0, PS_SEQ_TYPES)
+
+#define PS_INDEX_TYPES PS_SIMPLE_INDEX_TYPES PS_TOPK_INDEX_TYPES PS_COVERAGE_INDEX_TYPES
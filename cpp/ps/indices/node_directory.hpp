@@ -0,0 +1,162 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "ps/utils.hpp"
+#include "ps/sequences/sequence_types.hpp"
+#include "ps/sequences/sequence_file.hpp"
+#include "ps/indices/node.hpp"
+
+namespace ps {
+namespace indices {
+
+// Maps a docid to its postings offset, degree and score.
+//
+// The .off, .deg and .rnk files are EF sequences where .deg and .rnk store
+// cumulative values with an extra +1 per node to keep them strictly
+// increasing. The directory can either decode them once into a node_info
+// table (materialized) or answer every lookup with a select straight on the
+// mmapped files (lazy). In lazy mode the degree of a node is resolved with a
+// single move() on docid - 1 followed by next(), so both ends of the pair
+// come from the same region of the sequence.
+class node_directory {
+public:
+    typedef sequences::sequence_file<sequences::ef_seq> file_type;
+    typedef sequences::ef_seq::enumerator enumerator_type;
+
+    node_directory()
+        : m_num_docs(0)
+    {}
+
+    void materialize(const file_type& offsets,
+                     const file_type& degrees,
+                     const file_type* rankings = nullptr)
+    {
+        auto en_offs = offsets.sequence_at(0);
+        auto en_deg = degrees.sequence_at(0);
+
+        m_num_docs = en_offs.size();
+        m_docs.resize(m_num_docs);
+
+        if (!rankings)
+        {
+            for (size_t i = 0; i < m_num_docs; ++i, en_offs.next(), en_deg.next())
+                m_docs[i] = node_info(i, en_offs.docid(), en_deg.docid() - 1 - i, 0);
+
+            return;
+        }
+
+        auto en_ranks = rankings->sequence_at(0);
+        uint64_t prev_rank = 0;
+
+        for (size_t i = 0; i < m_num_docs; ++i, en_offs.next(), en_deg.next(), en_ranks.next())
+        {
+            uint64_t rank = abs((int64_t)en_ranks.docid() - (int64_t)prev_rank);
+            m_docs[i] = node_info(i, en_offs.docid(), en_deg.docid() - 1 - i, rank);
+            prev_rank = en_ranks.docid() + 1;
+        }
+    }
+
+    void map(const file_type& offsets,
+             const file_type& degrees,
+             const file_type* rankings = nullptr)
+    {
+        std::vector<node_info>().swap(m_docs);
+
+        m_offsets.reset(new enumerator_type(offsets.sequence_at(0)));
+        m_degrees.reset(new enumerator_type(degrees.sequence_at(0)));
+
+        if (rankings)
+            m_rankings.reset(new enumerator_type(rankings->sequence_at(0)));
+
+        m_num_docs = m_offsets->size();
+    }
+
+    // Used by the builders, which always keep the table in memory
+    std::vector<node_info>& docs()
+    {
+        m_num_docs = m_docs.size();
+        return m_docs;
+    }
+
+    bool lazy() const
+    {
+        return (bool)m_offsets;
+    }
+
+    uint64_t size() const
+    {
+        return lazy() ? m_num_docs : m_docs.size();
+    }
+
+    uint64_t offset(uint64_t docid) const
+    {
+        if (!lazy())
+            return m_docs[docid].offset;
+
+        enumerator_type en(*m_offsets);
+        en.move(docid);
+        return en.docid();
+    }
+
+    // Sum of the degrees of the nodes in [0, docid]
+    uint64_t cdf_degree(uint64_t docid) const
+    {
+        if (!lazy())
+            return m_docs[docid].cdf_degree;
+
+        enumerator_type en(*m_degrees);
+        en.move(docid);
+        return en.docid() - 1 - docid;
+    }
+
+    uint64_t degree(uint64_t docid) const
+    {
+        if (!lazy())
+            return m_docs[docid].cdf_degree - ((docid == 0) ? 0 : m_docs[docid - 1].cdf_degree);
+
+        return delta_at(*m_degrees, docid) - 1;
+    }
+
+    uint64_t score(uint64_t docid) const
+    {
+        if (!lazy())
+            return m_docs[docid].score;
+
+        uint64_t value = delta_at(*m_rankings, docid);
+        return (docid == 0) ? value : value - 1;
+    }
+
+    // Bytes kept on the heap by the directory, the mmapped files excluded
+    uint64_t memory_bytes() const
+    {
+        return m_docs.capacity() * sizeof(node_info);
+    }
+
+private:
+    static uint64_t PS_ALWAYSINLINE delta_at(const enumerator_type& prototype, uint64_t docid)
+    {
+        enumerator_type en(prototype);
+
+        if (docid == 0)
+        {
+            en.move(0);
+            return en.docid();
+        }
+
+        en.move(docid - 1);
+        uint64_t prev = en.docid();
+        en.next();
+        return en.docid() - prev;
+    }
+
+    uint64_t m_num_docs;
+    std::vector<node_info> m_docs;
+
+    std::unique_ptr<enumerator_type> m_offsets;
+    std::unique_ptr<enumerator_type> m_degrees;
+    std::unique_ptr<enumerator_type> m_rankings;
+};
+
+}
+}
@@ -7,7 +7,10 @@
 #include "ps/files.hpp"
 #include "ps/sequences/sequence_types.hpp"
 #include "ps/sequences/sequence_file.hpp"
+#include "ps/configuration.hpp"
 #include "ps/indices/node.hpp"
+#include "ps/indices/node_directory.hpp"
+#include "ps/indices/builders/segment.hpp"
 
 namespace ps {
 namespace indices {
@@ -18,18 +21,16 @@ class simple_index
 public:
     typedef Sequence sequence_type;
 
-    simple_index(const char* filename)
+    simple_index(const char* filename,
+                 bool lazy_nodes = configuration::get().indices_lazy_nodes)
         : m_seq_postings(filename, ".pos")
         , m_seq_offsets(filename, ".off")
         , m_seq_degrees(filename, ".deg")
     {
-        auto en_offs = m_seq_offsets.sequence_at(0);
-        auto en_deg = m_seq_degrees.sequence_at(0);
-
-        m_docs.resize(en_offs.size());
-
-        for (size_t i = 0; i < en_offs.size(); ++i, en_offs.next(), en_deg.next())
-            m_docs[i] = node_info(i, en_offs.docid(), en_deg.docid() - 1 - i, 0);
+        if (lazy_nodes)
+            m_nodes.map(m_seq_offsets, m_seq_degrees);
+        else
+            m_nodes.materialize(m_seq_offsets, m_seq_degrees);
     }
 
     simple_index(sequences::options opts, const char* filename)
@@ -71,10 +72,11 @@ public:
             offsets_builder.commit();
             degrees_builder.commit();
 
-            m_file.m_docs.resize(universe);
+            std::vector<node_info>& docs = m_file.m_nodes.docs();
+            docs.resize(universe);
 
-            for (uint64_t i = 0; i < m_file.m_docs.size(); ++i)
-                m_file.m_docs[i] = node_info(i, m_offsets[i], m_cdf_degrees[i] - 1, 0);
+            for (uint64_t i = 0; i < docs.size(); ++i)
+                docs[i] = node_info(i, m_offsets[i], m_cdf_degrees[i] - 1 - i, 0);
 
             m_offsets.clear();
             m_cdf_degrees.clear();
@@ -82,8 +84,39 @@ public:
 
         void append(uint64_t docid, std::string& str, uint64_t num_elements = 1)
         {
-            uint64_t offset = m_seq_postings_builder.append(str, num_elements);
+            add_node(docid, m_seq_postings_builder.append(str, num_elements), num_elements);
+        }
+
+        // Appends the lists of a chunk of nodes, in docid order, encoded back
+        // to back in encoded (see sequence_file::builder::append_batch)
+        void append_batch(const std::vector<uint64_t>& docids,
+                          const std::vector<uint64_t>& sizes,
+                          const std::string& encoded,
+                          const std::vector<uint64_t>& ends)
+        {
+            uint64_t num_elements = 0;
+            for (auto n : sizes)
+                num_elements += n;
+
+            m_seq_postings_builder.append_batch(encoded, ends, num_elements, m_batch_offsets);
+            for (size_t i = 0; i < docids.size(); ++i)
+                add_node(docids[i], m_batch_offsets[i], sizes[i]);
+        }
+
+        // Appends a segment built on its own. Its postings are copied as
+        // they are and its offsets rebased, so segments must come in docid
+        // order.
+        void append_segment(const segment<Sequence>& seg)
+        {
+            uint64_t base = m_seq_postings_builder.append_contents(seg.postings());
+
+            for (auto const& node : seg.nodes())
+                add_node(node.docid, base + node.offset, node.num_elements);
+        }
 
+    protected:
+        void add_node(uint64_t docid, uint64_t offset, uint64_t num_elements)
+        {
             assert(offset > m_last_offset || offset == 0);
             assert(docid >= m_last_docid);
 
@@ -101,7 +134,6 @@ public:
             m_cdf_degrees.emplace_back(m_cdf_degree);
         }
 
-    protected:
         simple_index& m_file;
         std::vector<uint64_t> m_offsets;
         std::vector<uint64_t> m_cdf_degrees;
@@ -111,31 +143,32 @@ public:
         uint64_t m_cdf_degree;
 
         typename sequences::sequence_file<Sequence>::builder m_seq_postings_builder;
+        std::vector<uint64_t> m_batch_offsets;
     };
 
     bool get_offset(uint64_t docid, uint64_t& offset) const
     {
-        offset = m_docs[docid].offset;
+        offset = m_nodes.offset(docid);
         return degree(docid) > 0;
     }
 
     uint64_t degree(uint64_t docid) const
     {
-        return m_docs[docid].cdf_degree - ((docid == 0) ? 0 : m_docs[docid - 1].cdf_degree);
+        return m_nodes.degree(docid);
     }
 
     std::string get_raw_sequence(uint64_t docid)
     {
         uint64_t end = docid + 1;
-        uint64_t start_offset = m_docs[docid].offset;
+        uint64_t start_offset = m_nodes.offset(docid);
 
-        while (end < m_docs.size() && m_docs[end].offset == start_offset)
+        while (end < m_nodes.size() && m_nodes.offset(end) == start_offset)
             end++;
 
-        uint64_t end_offset = (end < m_docs.size()) ? m_docs[end].offset : (m_seq_postings.file_size() - m_seq_postings.footer_size());
+        uint64_t end_offset = (end < m_nodes.size()) ? m_nodes.offset(end) : (m_seq_postings.file_size() - m_seq_postings.footer_size());
 
-        return std::string(m_seq_postings.data_at(m_docs[docid].offset),
-                           (size_t)(end_offset - m_docs[docid].offset));
+        return std::string(m_seq_postings.data_at(start_offset),
+                           (size_t)(end_offset - start_offset));
     }
 
     typename Sequence::enumerator sequence_at(uint64_t offset) const
@@ -145,7 +178,12 @@ public:
 
     uint64_t num_docs() const
     {
-        return m_docs.size();
+        return m_nodes.size();
+    }
+
+    const node_directory& nodes() const
+    {
+        return m_nodes;
     }
 
     uint64_t num_elements() const
@@ -153,6 +191,11 @@ public:
         return m_seq_postings.num_elements();
     }
 
+    uint64_t postings_bytes() const
+    {
+        return m_seq_postings.file_size();
+    }
+
     uint64_t construction_time_microsec() const
     {
         return m_seq_postings.construction_time_microsec();
@@ -183,7 +226,7 @@ public:
     }
 
 protected:
-    std::vector<node_info> m_docs;
+    node_directory m_nodes;
     sequences::sequence_file<Sequence> m_seq_postings;
     sequences::sequence_file<sequences::ef_seq> m_seq_offsets;
     sequences::sequence_file<sequences::ef_seq> m_seq_degrees;
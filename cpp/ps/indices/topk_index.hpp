@@ -4,6 +4,7 @@
 #include "succinct/mapper.hpp"
 #include "succinct/topk_vector.hpp"
 #include "ps/indices/simple_index.hpp"
+#include "ps/indices/node_directory.hpp"
 #include "ps/utils.hpp"
 #include "ps/indices/builders/rmq_sequences.hpp"
 #include "ps/configuration.hpp"
@@ -17,26 +18,18 @@ class topk_index
 public:
     typedef Sequence sequence_type;
 
-    topk_index(const char* filename)
+    topk_index(const char* filename,
+               bool lazy_nodes = configuration::get().indices_lazy_nodes)
         : m_seq_postings(filename, ".pos")
         , m_seq_offsets(filename, ".off")
         , m_seq_degrees(filename, ".deg")
         , m_seq_rankings(filename, ".rnk")
         , m_rmq_sequences(filename)
     {
-        auto en_offs = m_seq_offsets.sequence_at(0);
-        auto en_deg = m_seq_degrees.sequence_at(0);
-        auto en_ranks = m_seq_rankings.sequence_at(0);
-
-        uint64_t prev_rank = 0;
-        m_docs.resize(en_offs.size());
-
-        for (size_t i = 0; i < en_offs.size(); ++i, en_offs.next(), en_deg.next(), en_ranks.next())
-        {
-            uint64_t rank = abs((int64_t)en_ranks.docid() - (int64_t)prev_rank);
-            m_docs[i] = node_info(i, en_offs.docid(), en_deg.docid() - 1 - i, rank);
-            prev_rank = en_ranks.docid() + 1;
-        }
+        if (lazy_nodes)
+            m_nodes.map(m_seq_offsets, m_seq_degrees, &m_seq_rankings);
+        else
+            m_nodes.materialize(m_seq_offsets, m_seq_degrees, &m_seq_rankings);
     }
 
     topk_index(sequences::options opts, const char* filename, const std::string& ranking_file)
@@ -71,10 +64,11 @@ public:
                 m_cdf_degrees.emplace_back(++m_cdf_degree);
             }
 
-            m_file.m_docs.resize(universe);
+            std::vector<node_info>& docs = m_file.m_nodes.docs();
+            docs.resize(universe);
 
-            for (uint64_t i = 0; i < m_file.m_docs.size(); ++i)
-                m_file.m_docs[i] = node_info(i, m_offsets[i], m_cdf_degrees[i] - 1 - i, m_file.m_ranking[i]);
+            for (uint64_t i = 0; i < docs.size(); ++i)
+                docs[i] = node_info(i, m_offsets[i], m_cdf_degrees[i] - 1 - i, m_file.m_ranking[i]);
 
             typename sequences::sequence_file<sequences::ef_seq>::builder offsets_builder(
                 sequences::options(m_last_offset + 1), m_file.m_seq_offsets);
@@ -107,8 +101,28 @@ public:
 
         void append(uint64_t docid, std::string& str, uint64_t num_elements = 1)
         {
-            uint64_t offset = m_seq_postings_builder.append(str, num_elements);
+            add_node(docid, m_seq_postings_builder.append(str, num_elements), num_elements);
+        }
+
+        // Appends the lists of a chunk of nodes, in docid order, encoded back
+        // to back in encoded (see sequence_file::builder::append_batch)
+        void append_batch(const std::vector<uint64_t>& docids,
+                          const std::vector<uint64_t>& sizes,
+                          const std::string& encoded,
+                          const std::vector<uint64_t>& ends)
+        {
+            uint64_t num_elements = 0;
+            for (auto n : sizes)
+                num_elements += n;
 
+            m_seq_postings_builder.append_batch(encoded, ends, num_elements, m_batch_offsets);
+            for (size_t i = 0; i < docids.size(); ++i)
+                add_node(docids[i], m_batch_offsets[i], sizes[i]);
+        }
+
+    protected:
+        void add_node(uint64_t docid, uint64_t offset, uint64_t num_elements)
+        {
             assert(offset > m_last_offset || offset == 0);
             assert(docid >= m_last_docid || docid == 0);
 
@@ -126,7 +140,6 @@ public:
             m_cdf_degrees.emplace_back(m_cdf_degree);
         }
 
-    protected:
         void build_cartesian_tree()
         {
             // XX: not properly cartesian trees since they are bucketed
@@ -135,9 +148,11 @@ public:
 
             topk::rmq_sequences::builder builder(m_file.m_rmq_sequences);
 
-            for (uint64_t i = 0; i < m_file.m_docs.size(); ++i)
+            std::vector<node_info>& docs = m_file.m_nodes.docs();
+
+            for (uint64_t i = 0; i < docs.size(); ++i)
             {
-                node_info& n = m_file.m_docs[i];
+                node_info& n = docs[i];
                 std::vector<uint64_t> scores;
 
                 if (n.cdf_degree - prev_cdf > 0)
@@ -174,16 +189,17 @@ public:
         uint64_t m_cdf_degree;
 
         typename sequences::sequence_file<Sequence>::builder m_seq_postings_builder;
+        std::vector<uint64_t> m_batch_offsets;
     };
 
     uint64_t degree(uint64_t docid) const
     {
-        return m_docs[docid].cdf_degree - ((docid == 0) ? 0 : m_docs[docid - 1].cdf_degree);
+        return m_nodes.degree(docid);
     }
 
     bool get_offset(uint64_t docid, uint64_t& offset) const
     {
-        offset = m_docs[docid].offset;
+        offset = m_nodes.offset(docid);
         return degree(docid) > 0;
     }
 
@@ -192,7 +208,7 @@ public:
     bool get_rmq_sequence(uint64_t docid, rmq_sequence& s) const
     {
         uint64_t idx = m_rmq_sequences.get_index(docid);
-        uint64_t cdf_degree = (docid == 0 ? 0 : m_docs[docid - 1].cdf_degree);
+        uint64_t cdf_degree = (docid == 0 ? 0 : m_nodes.cdf_degree(docid - 1));
 
         if (idx > 0)
             s.m_topk_start_offset = cdf_degree - m_rmq_sequences.get_degree(idx);
@@ -200,7 +216,7 @@ public:
             s.m_topk_start_offset = cdf_degree;
 
         s.m_cartesian_tree = m_rmq_sequences.get_cartesian_tree(idx);
-        s.m_docs = &m_docs;
+        s.m_nodes = &m_nodes;
 
         return true;
     }
@@ -212,7 +228,12 @@ public:
 
     uint64_t num_docs() const
     {
-        return m_docs.size();
+        return m_nodes.size();
+    }
+
+    const node_directory& nodes() const
+    {
+        return m_nodes;
     }
 
     uint64_t num_elements() const
@@ -310,7 +331,7 @@ public:
 
                 m_enumerator.move(pos);
                 uint64_t docid = m_enumerator.docid();
-                uint64_t score = (*m_docs)[docid].score;
+                uint64_t score = m_nodes->score(docid);
 
                 m_q.emplace_back(docid, score, pos, cur_a, cur_pos - 1);
                 std::push_heap(m_q.begin(), m_q.end(), value_index_comparator());
@@ -321,7 +342,7 @@ public:
 
                 m_enumerator.move(pos);
                 uint64_t docid = m_enumerator.docid();
-                uint64_t score = (*m_docs)[docid].score;
+                uint64_t score = m_nodes->score(docid);
 
                 m_q.emplace_back(docid, score, pos, cur_pos + 1, cur_b);
                 std::push_heap(m_q.begin(), m_q.end(), value_index_comparator());
@@ -353,7 +374,7 @@ public:
             for (size_t i = a; i <= b; ++i, m_enumerator.next())
             {
                 uint64_t docid = m_enumerator.docid();
-                uint64_t score = (*m_docs)[docid].score;
+                uint64_t score = m_nodes->score(docid);
 
                 m_q.emplace_back(docid, score, i, i, i);
             }
@@ -371,7 +392,7 @@ public:
 
             m_enumerator.move(pos);
             uint64_t docid = m_enumerator.docid();
-            uint64_t score = (*m_docs)[docid].score;
+            uint64_t score = m_nodes->score(docid);
 
             m_q.emplace_back(docid, score, pos, a, b);
             std::push_heap(m_q.begin(), m_q.end(), value_index_comparator());
@@ -382,7 +403,7 @@ public:
         uint64_t m_threshold;
 
         const succinct::cartesian_tree* m_cartesian_tree;
-        const std::vector<node_info>* m_docs;
+        const node_directory* m_nodes;
         uint64_t m_topk_start_offset;
 
         std::vector<queue_element_type> m_q;
@@ -391,7 +412,7 @@ public:
     };
 
 protected:
-    std::vector<node_info> m_docs;
+    node_directory m_nodes;
     std::vector<uint64_t> m_ranking; // Will be used just during construction
     sequences::sequence_file<Sequence> m_seq_postings;
     sequences::sequence_file<sequences::ef_seq> m_seq_offsets;
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "ps/utils.hpp"
+
+namespace ps {
+namespace problems {
+
+// Turns the hits of a FoF query into a sorted list of distinct docids.
+//
+// The solvers append one sorted run per scanned list and mark the end of
+// each with add_run(). apply() then picks the cheapest of four ways to
+// deduplicate the runs, from the number of hits, the number of runs and the
+// width of the docids they span:
+//
+//   sort    std::sort and unique, for a handful of hits
+//   bitmap  set a bit per hit in a window over the span and scan it back,
+//           linear in the hits plus the span / 64
+//   merge   k-way merge of the runs with a loser tree, hits * log2(runs),
+//           only worth it for two or three runs over a very wide span
+//   radix   LSD radix sort with 11 bit digits, a pass per digit of the span
+//
+// The buffers, including the bitmap window (up to max_window_words), are
+// kept from one query to the next: use local() to get the instance of the
+// calling thread.
+class run_dedup {
+public:
+    enum method {
+        sort,
+        bitmap,
+        merge,
+        radix,
+    };
+
+    static const unsigned radix_bits = 11;
+    static const size_t sort_threshold = 32;
+    static const uint64_t max_window_words = 1 << 24;
+
+    static run_dedup& local()
+    {
+        static thread_local run_dedup d;
+        return d;
+    }
+
+    // Runs start at begin, hits before it are left as they are
+    void reset(size_t begin)
+    {
+        m_begin = begin;
+        m_ends.clear();
+    }
+
+    void add_run(size_t end)
+    {
+        size_t last = m_ends.empty() ? m_begin : m_ends.back();
+        if (end > last)
+            m_ends.push_back(end);
+    }
+
+    size_t num_runs() const
+    {
+        return m_ends.size();
+    }
+
+    // Costs in ns, measured with dedup_throughput in test/test_dedup.cpp
+    static method choose(size_t hits, size_t runs, uint64_t span)
+    {
+        if (hits <= sort_threshold)
+            return sort;
+
+        double costs[4];
+        costs[sort] = 2.5 * hits * std::log2(double(hits));
+        costs[bitmap] = span / 64 < max_window_words ? 1.5 * hits + 1.2 * (span / 64 + 1) : HUGE_VAL;
+        costs[merge] = 4.5 * hits * std::max(1.0, std::ceil(std::log2(double(runs))));
+        costs[radix] = (1.3 * hits + (1 << radix_bits) / 2) * passes(span);
+
+        return method(std::min_element(costs, costs + 4) - costs);
+    }
+
+    // Sorts and deduplicates the runs of hits, dropping exclude
+    method apply(std::vector<uint64_t>& hits, uint64_t exclude)
+    {
+        size_t n = m_ends.empty() ? 0 : m_ends.back() - m_begin;
+        if (!n) {
+            hits.resize(m_begin);
+            return sort;
+        }
+
+        method m = choose(n, m_ends.size(), span(hits));
+        apply(hits, exclude, m);
+        return m;
+    }
+
+    void apply(std::vector<uint64_t>& hits, uint64_t exclude, method m)
+    {
+        assert(m_ends.empty() || m_ends.back() == hits.size());
+
+        if (m_ends.empty()) {
+            hits.resize(m_begin);
+            return;
+        }
+
+        if (m_ends.size() == 1) // already sorted
+            m = sort;
+        else if (m == bitmap && span(hits) / 64 >= max_window_words)
+            m = radix;
+
+        switch (m) {
+        case sort:
+            sort_hits(hits, exclude);
+            break;
+        case bitmap:
+            bitmap_hits(hits, exclude);
+            break;
+        case merge:
+            merge_hits(hits, exclude);
+            break;
+        case radix:
+            radix_hits(hits, exclude);
+            break;
+        }
+    }
+
+private:
+    static unsigned passes(uint64_t span)
+    {
+        unsigned bits = 1;
+        while (bits < 64 && (span >> bits))
+            bits++;
+        return (bits + radix_bits - 1) / radix_bits;
+    }
+
+    // Runs are sorted, their extremes are at their ends
+    uint64_t span(const std::vector<uint64_t>& hits)
+    {
+        m_lo = UINT64_MAX;
+        m_hi = 0;
+
+        size_t start = m_begin;
+        for (auto end : m_ends) {
+            m_lo = std::min(m_lo, hits[start]);
+            m_hi = std::max(m_hi, hits[end - 1]);
+            start = end;
+        }
+
+        return m_hi - m_lo;
+    }
+
+    // Copies the sorted values back from begin, skipping duplicates and
+    // exclude
+    template <typename Iterator>
+    void emit_sorted(std::vector<uint64_t>& hits, Iterator first, Iterator last,
+                     uint64_t exclude)
+    {
+        size_t out = m_begin;
+        for (; first != last; ++first) {
+            uint64_t v = *first;
+            if (v == exclude || (out > m_begin && hits[out - 1] == v))
+                continue;
+            hits[out++] = v;
+        }
+        hits.resize(out);
+    }
+
+    void sort_hits(std::vector<uint64_t>& hits, uint64_t exclude)
+    {
+        if (m_ends.size() > 1)
+            std::sort(hits.begin() + m_begin, hits.end());
+        emit_sorted(hits, hits.begin() + m_begin, hits.end(), exclude);
+    }
+
+    void bitmap_hits(std::vector<uint64_t>& hits, uint64_t exclude)
+    {
+        span(hits);
+        size_t words = (m_hi - m_lo) / 64 + 1;
+        if (m_window.size() < words)
+            m_window.resize(words, 0);
+
+        uint64_t* window = m_window.data();
+        for (size_t i = m_begin; i < hits.size(); ++i) {
+            uint64_t v = hits[i] - m_lo;
+            window[v >> 6] |= uint64_t(1) << (v & 63);
+        }
+
+        if (m_lo <= exclude && exclude <= m_hi)
+            window[(exclude - m_lo) >> 6] &= ~(uint64_t(1) << ((exclude - m_lo) & 63));
+
+        // the window is left zeroed for the next query
+        size_t out = m_begin;
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t word = window[w];
+            window[w] = 0;
+            while (word) {
+                hits[out++] = m_lo + (w << 6) + __builtin_ctzll(word);
+                word &= word - 1;
+            }
+        }
+        hits.resize(out);
+    }
+
+    void merge_hits(std::vector<uint64_t>& hits, uint64_t exclude)
+    {
+        size_t k = m_ends.size();
+        m_pos.resize(k);
+        m_keys.resize(k);
+        for (size_t i = 0; i < k; ++i) {
+            m_pos[i] = i ? m_ends[i - 1] : m_begin;
+            m_keys[i] = hits[m_pos[i]]; // runs are not empty
+        }
+
+        m_tree.resize(k);
+        size_t winner = build_tree(1, k);
+
+        m_buffer.resize(hits.size() - m_begin);
+        uint64_t* out = m_buffer.data();
+        uint64_t last = UINT64_MAX;
+
+        for (;;) {
+            uint64_t v = m_keys[winner];
+            if (v == UINT64_MAX)
+                break;
+
+            if (v != last && v != exclude)
+                *out++ = v;
+            last = v;
+
+            size_t pos = ++m_pos[winner];
+            v = pos < m_ends[winner] ? hits[pos] : UINT64_MAX;
+            m_keys[winner] = v;
+
+            // replay the matches on the path from the leaf to the root
+            for (size_t node = (winner + k) / 2; node; node /= 2) {
+                uint64_t loser = m_keys[m_tree[node]];
+                if (loser < v) {
+                    std::swap(m_tree[node], winner);
+                    v = loser;
+                }
+            }
+        }
+
+        size_t n = out - m_buffer.data();
+        std::copy(m_buffer.data(), out, hits.begin() + m_begin);
+        hits.resize(m_begin + n);
+    }
+
+    // Leaves are the nodes k..2k-1, returns the winner of node and stores
+    // the losers on the way
+    size_t build_tree(size_t node, size_t k)
+    {
+        if (node >= k)
+            return node - k;
+
+        size_t a = build_tree(2 * node, k);
+        size_t b = build_tree(2 * node + 1, k);
+
+        if (m_keys[b] < m_keys[a])
+            std::swap(a, b);
+
+        m_tree[node] = b;
+        return a;
+    }
+
+    void radix_hits(std::vector<uint64_t>& hits, uint64_t exclude)
+    {
+        unsigned num_passes = passes(span(hits));
+        size_t n = hits.size() - m_begin;
+        const size_t buckets = size_t(1) << radix_bits;
+
+        for (size_t i = 0; i < n; ++i)
+            hits[m_begin + i] -= m_lo;
+
+        m_buffer.resize(n);
+        m_counts.resize(buckets);
+        uint64_t* src = hits.data() + m_begin;
+        uint64_t* dst = m_buffer.data();
+
+        for (unsigned p = 0; p < num_passes; ++p) {
+            unsigned shift = p * radix_bits;
+            std::fill(m_counts.begin(), m_counts.end(), 0);
+
+            for (size_t i = 0; i < n; ++i)
+                m_counts[(src[i] >> shift) & (buckets - 1)]++;
+
+            size_t sum = 0;
+            for (auto& c : m_counts) {
+                size_t count = c;
+                c = sum;
+                sum += count;
+            }
+
+            for (size_t i = 0; i < n; ++i)
+                dst[m_counts[(src[i] >> shift) & (buckets - 1)]++] = src[i];
+
+            std::swap(src, dst);
+        }
+
+        for (size_t i = 0; i < n; ++i)
+            src[i] += m_lo;
+
+        if (src == m_buffer.data())
+            emit_sorted(hits, m_buffer.begin(), m_buffer.end(), exclude);
+        else
+            emit_sorted(hits, hits.begin() + m_begin, hits.end(), exclude);
+    }
+
+    size_t m_begin = 0;
+    std::vector<size_t> m_ends;
+    uint64_t m_lo = 0;
+    uint64_t m_hi = 0;
+
+    std::vector<uint64_t> m_window;
+    std::vector<uint64_t> m_buffer;
+    std::vector<size_t> m_pos;
+    std::vector<uint64_t> m_keys;
+    std::vector<size_t> m_tree;
+    std::vector<size_t> m_counts;
+};
+
+}
+}
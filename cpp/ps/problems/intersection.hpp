@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ps/problems/schemes.hpp"
+#include "ps/problems/dedup.hpp"
+#include "ps/problems/parallel.hpp"
 #include "ps/indices/index_types.hpp"
 
 namespace ps {
@@ -14,23 +16,7 @@ void do_enumerator_intersection(IndexEnumerator& en,
                                 const int r,
                                 std::vector<uint64_t>& result)
 {
-    if (en.docid() < (uint64_t)l)
-        en.next_geq((uint64_t)l);
-
-    if (PS_UNLIKELY(en.docid() < (uint64_t)l ||
-                    en.docid() >= (uint64_t)r ||
-                    en.position() == en.size()))
-        return;
-
-    for (size_t i = en.position(); i < en.size(); ++i, en.next())
-    {
-        uint64_t docid = en.docid();
-
-        if (docid < (uint64_t)r)
-            result.push_back(docid);
-        else
-            return;
-    }
+    en.extract_range((uint64_t)l, (uint64_t)r, result);
 }
 
 template<typename IndexEnumerator>
@@ -83,6 +69,12 @@ public:
         : m_index(index)
     {}
 
+    // When hopping a hub is split across threads, see hub_split
+    void set_parallel(size_t min_degree, double min_work)
+    {
+        m_split.set_thresholds(min_degree, min_work);
+    }
+
     void solve(uint64_t docid, int l, int r, std::vector<uint64_t>& res)
     {
         throw std::runtime_error("Not supported");
@@ -94,16 +86,20 @@ public:
         if (!m_index.get_offset(docid, offset))
             return;
 
+        run_dedup& runs = run_dedup::local();
+        runs.reset(result.size());
+
         solve_asindex_inline(docid, remapping, result);
+        runs.add_run(result.size());
 
         auto en = m_index.sequence_at(offset);
 
-        for (size_t i = 0; i < en.size(); ++i, en.next())
+        for (size_t i = 0; i < en.size(); ++i, en.next()) {
             solve_asindex_inline(en.docid(), remapping, result);
+            runs.add_run(result.size());
+        }
 
-        std::sort(result.begin(), result.end());
-        result.erase(std::unique(result.begin(), result.end()), result.end());
-        result.erase(std::remove(result.begin(), result.end(), docid), result.end());
+        runs.apply(result, docid);
     }
 
     void solve_baseline_asindex(uint64_t docid, std::vector<uint64_t>& remapping, std::vector<uint64_t>& result)
@@ -118,16 +114,20 @@ public:
         if (!m_index.get_offset(docid, offset))
             return;
 
+        run_dedup& runs = run_dedup::local();
+        runs.reset(result.size());
+
         solve_fast_asindex_inline(docid, l, r, remapping, result);
+        runs.add_run(result.size());
 
         auto en = m_index.sequence_at(offset);
 
-        for (size_t i = 0; i < en.size(); ++i, en.next())
+        for (size_t i = 0; i < en.size(); ++i, en.next()) {
             solve_fast_asindex_inline(en.docid(), l, r, remapping, result);
+            runs.add_run(result.size());
+        }
 
-        std::sort(result.begin(), result.end());
-        result.erase(std::unique(result.begin(), result.end()), result.end());
-        result.erase(std::remove(result.begin(), result.end(), docid), result.end());
+        runs.apply(result, docid);
     }
 
     void solve_fast_baseline_asindex(uint64_t docid, int l, int r,
@@ -143,16 +143,51 @@ protected:
         if (!m_index.get_offset(docid, offset))
             return;
 
-        solve_asindex_inline(docid, l, r, result);
-
         auto en = m_index.sequence_at(offset);
 
-        for (size_t i = 0; i < en.size(); ++i, en.next())
+        if (PS_UNLIKELY(m_split.split(m_index, Scheme::Hopping, docid, en, l, r, 0)))
+            return solve_hopping_parallel(docid, l, r, result);
+
+        run_dedup& runs = run_dedup::local();
+        runs.reset(result.size());
+
+        solve_asindex_inline(docid, l, r, result);
+        runs.add_run(result.size());
+
+        for (size_t i = 0; i < en.size(); ++i, en.next()) {
             solve_asindex_inline(en.docid(), l, r, result);
+            runs.add_run(result.size());
+        }
+
+        runs.apply(result, docid);
+    }
 
-        std::sort(result.begin(), result.end());
-        result.erase(std::unique(result.begin(), result.end()), result.end());
-        result.erase(std::remove(result.begin(), result.end(), docid), result.end());
+    // Every chunk deduplicates its own runs, the sorted chunks are then
+    // deduplicated as the runs of the query
+    void solve_hopping_parallel(uint64_t docid, int l, int r, std::vector<uint64_t>& result)
+    {
+        m_chunks.resize(m_split.num_chunks());
+
+        m_split.run([&](size_t c) {
+            std::vector<uint64_t>& hits = m_chunks[c];
+            hits.clear();
+
+            run_dedup& runs = run_dedup::local();
+            runs.reset(0);
+            for (auto it = m_split.begin(c); it != m_split.end(c); ++it) {
+                solve_asindex_inline(*it, l, r, hits);
+                runs.add_run(hits.size());
+            }
+            runs.apply(hits, docid);
+        });
+
+        run_dedup& runs = run_dedup::local();
+        runs.reset(result.size());
+        for (auto const& hits : m_chunks) {
+            result.insert(result.end(), hits.begin(), hits.end());
+            runs.add_run(result.size());
+        }
+        runs.apply(result, docid);
     }
 
     void solve_asindex(uint64_t docid, int l, int r, std::vector<uint64_t>& result)
@@ -196,9 +231,12 @@ protected:
     }
 
     const Index& m_index;
+
+    hub_split m_split;
+    std::vector<std::vector<uint64_t>> m_chunks;
 };
 
-// Hopping is only defined for simple indices
+// Hopping is only defined for simple and coverage indices
 #define LOOP_BODY(R, DATA, T)                                           \
 template<>                                                              \
 void solver<BOOST_PP_CAT(indices::T, _index), Schemes::hopping>::solve( \
@@ -208,9 +246,10 @@ void solver<BOOST_PP_CAT(indices::T, _index), Schemes::hopping>::solve( \
 }
 
 BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SIMPLE_INDEX_TYPES);
+BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_COVERAGE_INDEX_TYPES);
 #undef LOOP_BODY
 
-// AsIndex is only defined for simple indices
+// AsIndex is only defined for simple and coverage indices
 #define LOOP_BODY(R, DATA, T)                                           \
 template<>                                                              \
 void solver<BOOST_PP_CAT(indices::T, _index), Schemes::asindex>::solve( \
@@ -220,6 +259,26 @@ void solver<BOOST_PP_CAT(indices::T, _index), Schemes::asindex>::solve( \
 }
 
 BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SIMPLE_INDEX_TYPES);
+BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_COVERAGE_INDEX_TYPES);
+#undef LOOP_BODY
+
+// Coverage scans the materialized N2 list of the user when it has one and
+// falls back to hopping otherwise
+#define LOOP_BODY(R, DATA, T)                                            \
+template<>                                                               \
+void solver<BOOST_PP_CAT(indices::T, _index), Schemes::coverage>::solve( \
+    uint64_t docid, int l, int r, std::vector<uint64_t>& res)            \
+{                                                                        \
+    uint64_t offset;                                                     \
+    if (m_index.get_coverage_offset(docid, offset)) {                    \
+        auto en = m_index.coverage_at(offset);                           \
+        detail::do_enumerator_intersection(en, l, r, res);               \
+    } else {                                                             \
+        solve_hopping(docid, l, r, res);                                 \
+    }                                                                    \
+}
+
+BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_COVERAGE_INDEX_TYPES);
 #undef LOOP_BODY
 
 }
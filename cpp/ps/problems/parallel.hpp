@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "ps/configuration.hpp"
+#include "ps/queues.hpp"
+#include "ps/problems/planner.hpp"
+
+namespace ps {
+namespace problems {
+
+// Splits a FoF query on a hub into chunks that run on the shared task_pool.
+//
+// A query is split when the user has at least min_degree friends and the
+// planner estimates more than min_work units for it (see
+// PS_SOLVERS_PARALLEL_DEGREE and PS_SOLVERS_PARALLEL_WORK). Smaller queries
+// only pay for the degree check. The lists to scan, the user's own and the
+// ones of its friends, are weighted with the units of scanning each of them
+// alone and cut into consecutive chunks of about the same weight, at least
+// min_work / 4 each and up to four per thread so that idle threads can
+// balance the load.
+class hub_split {
+public:
+    hub_split(size_t min_degree = configuration::get().solvers_parallel_degree,
+              double min_work = configuration::get().solvers_parallel_work,
+              queues::task_pool* pool = nullptr)
+        : m_min_degree(min_degree)
+        , m_min_work(min_work)
+        , m_pool(pool)
+    {}
+
+    void set_thresholds(size_t min_degree, double min_work)
+    {
+        m_min_degree = min_degree;
+        m_min_work = min_work;
+    }
+
+    // en is positioned at the first friend of docid. False if the query
+    // stays on the calling thread.
+    template <typename Index, typename Enumerator>
+    bool split(const Index& index, Scheme scheme, uint64_t docid,
+               Enumerator en, int l, int r, int k)
+    {
+        if (PS_LIKELY(en.size() < m_min_degree) || !pool().num_threads())
+            return false;
+
+        query_stats list;
+        list.degree = 0;
+        list.n2 = -1;
+        list.width = r > l ? uint64_t(r - l) : 0;
+        list.fraction = index.num_docs() ? double(list.width) / index.num_docs() : 1.0;
+        list.k = k;
+
+        query_stats s = list;
+        s.degree = en.size();
+        s.friend_degrees = 0;
+
+        m_lists.clear();
+        m_weights.clear();
+        m_lists.push_back(docid);
+        m_weights.push_back(index.degree(docid));
+
+        for (size_t i = 0; i < en.size(); ++i, en.next()) {
+            uint64_t degree = index.degree(en.docid());
+            m_lists.push_back(en.docid());
+            m_weights.push_back(degree);
+            s.friend_degrees += degree;
+        }
+
+        double work = planner<Index>::units(scheme, s);
+        if (work < m_min_work)
+            return false;
+
+        double total = 0;
+        for (auto& w : m_weights) {
+            list.friend_degrees = uint64_t(w);
+            w = planner<Index>::units(scheme, list);
+            total += w;
+        }
+
+        size_t max_chunks = 4 * (pool().num_threads() + 1);
+        size_t chunks = std::min(max_chunks, size_t(work / (m_min_work / 4)));
+        chunks = std::max<size_t>(2, std::min(chunks, m_lists.size()));
+
+        m_bounds.assign(1, 0);
+        double sum = 0;
+        for (size_t i = 0; i < m_lists.size(); ++i) {
+            sum += m_weights[i];
+            if (sum >= total * m_bounds.size() / chunks && m_bounds.size() < chunks)
+                m_bounds.push_back(i + 1);
+        }
+        if (m_bounds.back() != m_lists.size())
+            m_bounds.push_back(m_lists.size());
+
+        return true;
+    }
+
+    size_t num_chunks() const
+    {
+        return m_bounds.size() - 1;
+    }
+
+    // Lists of chunk i, the user's own is the first of chunk 0
+    const uint64_t* begin(size_t i) const
+    {
+        return m_lists.data() + m_bounds[i];
+    }
+
+    const uint64_t* end(size_t i) const
+    {
+        return m_lists.data() + m_bounds[i + 1];
+    }
+
+    // Calls task(i) for every chunk and returns when all are done
+    void run(const queues::task_pool::task& task)
+    {
+        pool().run(num_chunks(), task);
+    }
+
+private:
+    queues::task_pool& pool()
+    {
+        return m_pool ? *m_pool : queues::task_pool::shared();
+    }
+
+    size_t m_min_degree;
+    double m_min_work;
+    queues::task_pool* m_pool;
+
+    std::vector<uint64_t> m_lists;
+    std::vector<double> m_weights;
+    std::vector<size_t> m_bounds;
+};
+
+}
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+#include "ps/problems/schemes.hpp"
+#include "ps/indices/index_types.hpp"
+
+namespace ps {
+namespace problems {
+
+// What a query asks for. The schemes that answer the same problem give the
+// same results and can stand in for each other.
+enum class Problem
+{
+    Friends,
+    FriendsOfFriends,
+    TopkFriendsOfFriends,
+};
+
+inline Problem problem_of(Scheme scheme)
+{
+    switch (scheme) {
+    case Scheme::AsIndex:
+    case Scheme::BaselineAsIndex:
+    case Scheme::FastBaselineAsIndex:
+        return Problem::Friends;
+    case Scheme::Hopping:
+    case Scheme::Coverage:
+    case Scheme::BaselineHopping:
+    case Scheme::FastBaselineHopping:
+        return Problem::FriendsOfFriends;
+    default:
+        return Problem::TopkFriendsOfFriends;
+    }
+}
+
+// Estimated time of a scheme in ns: fixed + per_unit * units, where the
+// units of a query come from planner::units(). The defaults are rough
+// figures; planner::calibrate() fits per_unit to measured queries.
+struct cost_model {
+    cost_model()
+    {
+        std::fill(fixed, fixed + num_schemes, 200.0);
+        std::fill(per_unit, per_unit + num_schemes, 2.0);
+        per_unit[size_t(Scheme::BaselineAsIndex)] = 4.0;
+        per_unit[size_t(Scheme::BaselineHopping)] = 4.0;
+        per_unit[size_t(Scheme::FastBaselineAsIndex)] = 1.0;
+        per_unit[size_t(Scheme::FastBaselineHopping)] = 1.0;
+        per_unit[size_t(Scheme::TopkHoppingRMQ)] = 4.0;
+        per_unit[size_t(Scheme::TopkHoppingRMQWAND)] = 4.0;
+    }
+
+    double fixed[num_schemes];
+    double per_unit[num_schemes];
+};
+
+// Statistics a plan is made from
+struct query_stats {
+    uint64_t degree;            // friends of the user
+    uint64_t friend_degrees;    // sum of the degrees of the friends
+    int64_t n2;                 // materialized N2 list, -1 if there is none
+    uint64_t width;             // r - l
+    double fraction;            // of the docids in [l, r)
+    int k;
+};
+
+struct plan {
+    struct estimate {
+        Scheme scheme;
+        double units;
+        double nsec;
+    };
+
+    Scheme requested;
+    Scheme chosen;
+    query_stats stats;
+    std::vector<estimate> estimates; // applicable schemes only
+
+    void explain(std::ostream& os) const
+    {
+        os << "plan: requested=" << scheme_name(requested)
+           << " degree=" << stats.degree
+           << " friend-degrees=" << stats.friend_degrees;
+        if (stats.n2 >= 0)
+            os << " n2=" << stats.n2;
+        os << " width=" << stats.width
+           << " k=" << stats.k << "\n";
+
+        for (auto const& e : estimates) {
+            os << (e.scheme == chosen ? "  * " : "    ")
+               << std::left << std::setw(24) << scheme_name(e.scheme) << std::right
+               << " units=" << std::setw(12) << uint64_t(e.units)
+               << " est-nsec=" << std::setw(12) << uint64_t(e.nsec) << "\n";
+        }
+    }
+};
+
+namespace plan_detail {
+
+template <typename Index>
+struct index_kind {
+    static const bool coverage = false;
+    static const bool topk = false;
+};
+
+template <typename Sequence>
+struct index_kind<indices::coverage_index<Sequence>> {
+    static const bool coverage = true;
+    static const bool topk = false;
+};
+
+template <typename Sequence>
+struct index_kind<indices::topk_index<Sequence>> {
+    static const bool coverage = false;
+    static const bool topk = true;
+};
+
+template <typename Index>
+int64_t coverage_degree(const Index& index, uint64_t docid)
+{
+    return -1;
+}
+
+template <typename Sequence>
+int64_t coverage_degree(const indices::coverage_index<Sequence>& index, uint64_t docid)
+{
+    uint64_t offset;
+    return index.get_coverage_offset(docid, offset) ? int64_t(index.coverage().degree(docid)) : -1;
+}
+
+}
+
+// Picks the scheme of a query among the ones that answer the same problem,
+// from the degree of the user, the sum of the degrees of its friends, the
+// width of the prefix range and a cost model.
+//
+// The units of a scheme approximate its work: a list opened counts as
+// list_units (a lookup in the node directory and a next_geq), a posting
+// read or a position of the remapping scanned as one. The baseline schemes
+// are only considered with a dict remapping, WAND only with its data.
+template <typename Index>
+class planner {
+public:
+    static constexpr double list_units = 16.0;
+
+    planner(const Index& index, bool remapping, bool wand,
+            const cost_model& model = cost_model())
+        : m_index(index)
+        , m_remapping(remapping)
+        , m_wand(wand)
+        , m_model(model)
+    {}
+
+    const cost_model& model() const
+    {
+        return m_model;
+    }
+
+    query_stats stats(Scheme requested, uint64_t docid, int l, int r, int k) const
+    {
+        query_stats s;
+        s.degree = m_index.degree(docid);
+        s.friend_degrees = 0;
+        s.n2 = plan_detail::coverage_degree(m_index, docid);
+        s.width = r > l ? uint64_t(r - l) : 0;
+        s.fraction = m_index.num_docs() ? double(s.width) / m_index.num_docs() : 1.0;
+        s.k = k;
+
+        uint64_t offset;
+        if (problem_of(requested) != Problem::Friends && m_index.get_offset(docid, offset)) {
+            auto en = m_index.sequence_at(offset);
+            for (size_t i = 0; i < en.size(); ++i, en.next())
+                s.friend_degrees += m_index.degree(en.docid());
+        }
+
+        return s;
+    }
+
+    bool applicable(Scheme scheme, Problem problem) const
+    {
+        if (problem_of(scheme) != problem)
+            return false;
+
+        typedef plan_detail::index_kind<Index> kind;
+        switch (scheme) {
+        case Scheme::Coverage:
+            return kind::coverage;
+        case Scheme::BaselineAsIndex:
+        case Scheme::BaselineHopping:
+        case Scheme::FastBaselineAsIndex:
+        case Scheme::FastBaselineHopping:
+            return m_remapping;
+        case Scheme::TopkHopping:
+            return !kind::topk;
+        case Scheme::TopkHoppingWAND:
+            return !kind::topk && m_wand;
+        case Scheme::TopkHoppingRMQ:
+        case Scheme::TopkHoppingRMQWAND:
+            return kind::topk;
+        default:
+            return true;
+        }
+    }
+
+    static double units(Scheme scheme, const query_stats& s)
+    {
+        double lists = list_units * (s.degree + 1);
+        double hits = s.friend_degrees * s.fraction;
+        double k = std::max(s.k, 1);
+        double log_w = std::log2(double(s.width) + 2);
+
+        switch (scheme) {
+        case Scheme::AsIndex:
+            return list_units + s.degree * s.fraction;
+        case Scheme::BaselineAsIndex:
+            return s.width * log_w + std::min<double>(s.width, s.degree);
+        case Scheme::FastBaselineAsIndex:
+            return list_units + s.degree;
+        case Scheme::Hopping:
+            return lists + hits + s.degree * s.fraction;
+        case Scheme::Coverage:
+            return s.n2 >= 0 ? list_units + s.n2 * s.fraction
+                             : units(Scheme::Hopping, s);
+        case Scheme::BaselineHopping:
+            return s.width * log_w + (s.degree + 1) * double(s.width);
+        case Scheme::FastBaselineHopping:
+            return lists + s.friend_degrees + s.degree;
+        case Scheme::TopkHopping:
+            return lists + hits * std::log2(k + 1);
+        case Scheme::TopkHoppingWAND:
+            return lists + std::min(hits, k * (s.degree + 1)) * std::log2(k + 1);
+        case Scheme::TopkHoppingRMQ:
+            return lists + (s.degree + 1) * std::min(k, hits / (s.degree + 1) + 1);
+        case Scheme::TopkHoppingRMQWAND:
+            return lists + k * std::log2(double(s.degree) + 2);
+        }
+        return 0;
+    }
+
+    double estimate(Scheme scheme, const query_stats& s) const
+    {
+        return m_model.fixed[size_t(scheme)] + m_model.per_unit[size_t(scheme)] * units(scheme, s);
+    }
+
+    // The requested scheme stays if nothing else answers its problem
+    plan make_plan(Scheme requested, uint64_t docid, int l, int r, int k) const
+    {
+        plan p;
+        p.requested = requested;
+        p.chosen = requested;
+        p.stats = stats(requested, docid, l, r, k);
+
+        Problem problem = problem_of(requested);
+        double best = HUGE_VAL;
+
+        for (size_t i = 0; i < num_schemes; ++i) {
+            Scheme scheme = Scheme(i);
+            if (!applicable(scheme, problem))
+                continue;
+
+            plan::estimate e = {scheme, units(scheme, p.stats), estimate(scheme, p.stats)};
+            p.estimates.push_back(e);
+
+            if (e.nsec < best) {
+                best = e.nsec;
+                p.chosen = scheme;
+            }
+        }
+
+        return p;
+    }
+
+    Scheme choose(Scheme requested, uint64_t docid, int l, int r, int k) const
+    {
+        return make_plan(requested, docid, l, r, k).chosen;
+    }
+
+    // A query timed with a given scheme
+    struct sample {
+        Scheme scheme;
+        query_stats stats;
+        double nsec;
+    };
+
+    // Fits per_unit of every scheme with samples to the average measured
+    // time per unit, on top of its fixed cost
+    void calibrate(const std::vector<sample>& samples)
+    {
+        double nsec[num_schemes] = {0};
+        double total_units[num_schemes] = {0};
+
+        for (auto const& s : samples) {
+            size_t i = size_t(s.scheme);
+            nsec[i] += std::max(0.0, s.nsec - m_model.fixed[i]);
+            total_units[i] += units(s.scheme, s.stats);
+        }
+
+        for (size_t i = 0; i < num_schemes; ++i) {
+            if (total_units[i] > 0)
+                m_model.per_unit[i] = std::max(nsec[i] / total_units[i], 1e-3);
+        }
+    }
+
+private:
+    const Index& m_index;
+    bool m_remapping;
+    bool m_wand;
+    cost_model m_model;
+};
+
+}
+}
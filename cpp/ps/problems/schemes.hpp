@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string>
+#include <utility>
+
 namespace ps {
 namespace problems {
 
@@ -34,5 +37,48 @@ struct Schemes {
     static const Scheme topk_hopping_rmq_wand = Scheme::TopkHoppingRMQWAND;
 };
 
+static const size_t num_schemes = size_t(Scheme::TopkHoppingRMQWAND) + 1;
+
+// Names of the schemes on the command line
+typedef std::pair<const char*, Scheme> scheme_name_type;
+
+inline const scheme_name_type* scheme_names()
+{
+    static const scheme_name_type names[num_schemes] = {
+        {"hopping", Scheme::Hopping},
+        {"asindex", Scheme::AsIndex},
+        {"coverage", Scheme::Coverage},
+        {"baseline-hopping", Scheme::BaselineHopping},
+        {"baseline-asindex", Scheme::BaselineAsIndex},
+        {"fast-baseline-hopping", Scheme::FastBaselineHopping},
+        {"fast-baseline-asindex", Scheme::FastBaselineAsIndex},
+        {"topk-hopping", Scheme::TopkHopping},
+        {"topk-hopping-rmq", Scheme::TopkHoppingRMQ},
+        {"topk-hopping-wand", Scheme::TopkHoppingWAND},
+        {"topk-hopping-rmq-wand", Scheme::TopkHoppingRMQWAND},
+    };
+    return names;
+}
+
+inline bool scheme_from_name(const std::string& name, Scheme& scheme)
+{
+    for (size_t i = 0; i < num_schemes; ++i) {
+        if (name == scheme_names()[i].first) {
+            scheme = scheme_names()[i].second;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline const char* scheme_name(Scheme scheme)
+{
+    for (size_t i = 0; i < num_schemes; ++i) {
+        if (scheme_names()[i].second == scheme)
+            return scheme_names()[i].first;
+    }
+    return "unknown";
+}
+
 }
 }
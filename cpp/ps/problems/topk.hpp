@@ -3,6 +3,7 @@
 #include <boost/chrono.hpp>
 #include "ps/problems/schemes.hpp"
 #include "ps/containers.hpp"
+#include "ps/problems/parallel.hpp"
 #include "ps/indices/index_types.hpp"
 
 namespace ps {
@@ -80,26 +81,14 @@ void do_enumerator_intersection(IndexEnumerator& en,
                                 const int l,
                                 const int r,
                                 topk_heap& heap,
-                                const std::vector<uint64_t>& ranking)
+                                const std::vector<uint64_t>& ranking,
+                                std::vector<uint64_t>& buffer)
 {
-    if (en.docid() < (uint64_t)l)
-        en.next_geq((uint64_t)l);
+    buffer.clear();
+    en.extract_range((uint64_t)l, (uint64_t)r, buffer);
 
-    if (PS_UNLIKELY(en.docid() < (uint64_t)l ||
-                    en.docid() >= (uint64_t)r ||
-                    en.position() == en.size()))
-        return;
-
-    for (size_t i = en.position(); i < en.size(); ++i, en.next())
-    {
-        uint64_t docid = en.docid();
-        uint64_t rank = ranking[docid];
-
-        if (docid < (uint64_t)r)
-            heap.push(std::make_pair(docid, rank));
-        else
-            break;
-    }
+    for (uint64_t docid : buffer)
+        heap.push(std::make_pair(docid, ranking[docid]));
 }
 
 }
@@ -124,6 +113,18 @@ public:
         throw std::runtime_error("Not supported");
     }
 
+    // Lets a solver, and its scratch space, be reused across queries
+    void set_k(int k)
+    {
+        m_k = k;
+    }
+
+    // When a hub is split across threads, see hub_split
+    void set_parallel(size_t min_degree, double min_work)
+    {
+        m_split.set_thresholds(min_degree, min_work);
+    }
+
 protected:
     void solve_hopping(uint64_t docid, int l, int r, std::vector<uint64_t>& result)
     {
@@ -131,10 +132,13 @@ protected:
         if (!m_index.get_offset(docid, offset))
             return;
 
-        topk_heap heap(m_k, std::make_pair(docid, m_ranking[docid]));
-
         auto en = m_index.sequence_at(offset);
 
+        if (PS_UNLIKELY(m_split.split(m_index, Scheme::TopkHopping, docid, en, l, r, m_k)))
+            return solve_hopping_parallel(docid, l, r, false, result);
+
+        topk_heap heap(m_k, std::make_pair(docid, m_ranking[docid]));
+
         solve_asindex_inline(docid, l, r, heap);
 
         for (size_t i = en.position(); i < en.size(); ++i, en.next())
@@ -159,6 +163,9 @@ protected:
 
         auto en = m_index.sequence_at(offset);
 
+        if (PS_UNLIKELY(m_split.split(m_index, Scheme::TopkHoppingWAND, docid, en, l, r, m_k)))
+            return solve_hopping_parallel(docid, l, r, true, result);
+
         topk_heap heap(m_k, std::make_pair(docid, m_ranking[docid]));
         std::vector<std::pair<uint64_t, uint64_t>> docids;
 
@@ -277,9 +284,13 @@ protected:
         if (!m_index.get_offset(docid, offset))
             return;
 
+        auto en = m_index.sequence_at(offset);
+
+        if (PS_UNLIKELY(m_split.split(m_index, Scheme::TopkHoppingRMQ, docid, en, l, r, m_k)))
+            return solve_hopping_rmq_parallel(docid, l, r, result);
+
         solve_rmq_inline(docid, l, r, heap);
 
-        auto en = m_index.sequence_at(offset);
         for (size_t i = 0; i < en.size(); ++i, en.next())
             solve_rmq_inline(en.docid(), l, r, heap);
 
@@ -307,6 +318,118 @@ protected:
         result.resize(extracted);
     }
 
+    // Every chunk keeps the top k of its lists, with WAND pruning among its
+    // lists only, and the top k of the query is the top k of the chunks'
+    void solve_hopping_parallel(uint64_t docid, int l, int r, bool wand,
+                                std::vector<uint64_t>& result)
+    {
+        const ranked_docid sentinel(docid, m_ranking[docid]);
+        m_chunks.resize(m_split.num_chunks());
+
+        m_split.run([&](size_t c) {
+            chunk& ch = m_chunks[c];
+            topk_heap heap(m_k, sentinel);
+
+            if (wand) {
+                ch.docids.clear();
+                for (auto it = m_split.begin(c); it != m_split.end(c); ++it)
+                    ch.docids.emplace_back(*it, m_wand[*it]);
+
+                std::sort(ch.docids.begin(), ch.docids.end(),
+                          [](const ranked_docid& a, const ranked_docid& b) {
+                              return a.second > b.second;
+                          });
+
+                for (auto& p: ch.docids)
+                {
+                    if (heap.full() && p.second < heap.minimum().second)
+                        break;
+
+                    solve_asindex_inline(p.first, l, r, heap, ch.buffer);
+                }
+            } else {
+                for (auto it = m_split.begin(c); it != m_split.end(c); ++it)
+                    solve_asindex_inline(*it, l, r, heap, ch.buffer);
+            }
+
+            ch.hits.assign(heap.steal().begin(), heap.steal().end());
+        });
+
+        topk_heap heap(m_k, sentinel);
+        for (auto const& ch : m_chunks)
+            for (auto const& hit : ch.hits)
+                heap.push(hit);
+
+        int extracted = 0;
+
+        while (!heap.empty())
+        {
+            result[extracted++] = heap.top().first;
+            heap.pop();
+        }
+
+        result.resize(extracted);
+    }
+
+    // Every chunk extracts the top k of its lists like solve_hopping_rmq,
+    // in the same order
+    void solve_hopping_rmq_parallel(uint64_t docid, int l, int r, std::vector<uint64_t>& result)
+    {
+        m_chunks.resize(m_split.num_chunks());
+
+        m_split.run([&](size_t c) {
+            chunk& ch = m_chunks[c];
+            ch.hits.clear();
+
+            topk_rmq_heap heap;
+            for (auto it = m_split.begin(c); it != m_split.end(c); ++it)
+                solve_rmq_inline(*it, l, r, heap);
+
+            uint64_t previous = UINT_MAX;
+
+            while (!heap.empty() && ch.hits.size() < (size_t)m_k)
+            {
+                rmq_sequence& s = heap.top();
+
+                uint64_t target = std::get<0>(s.value());
+
+                if (target != docid && target != previous)
+                {
+                    ch.hits.emplace_back(target, std::get<1>(s.value()));
+                    previous = target;
+                }
+
+                if (s.next())
+                    heap.reinsert();
+                else
+                    heap.pop();
+            }
+        });
+
+        m_merged.clear();
+        for (auto const& ch : m_chunks)
+            m_merged.insert(m_merged.end(), ch.hits.begin(), ch.hits.end());
+
+        std::sort(m_merged.begin(), m_merged.end(), compare_rank_docids(true));
+
+        uint64_t previous = UINT_MAX;
+        int extracted = 0;
+
+        for (auto const& hit : m_merged)
+        {
+            if (extracted == m_k)
+                break;
+
+            if (hit.first != previous)
+            {
+                result[extracted++] = hit.first;
+                previous = hit.first;
+            }
+        }
+
+        result.resize(extracted);
+    }
+
     bool PS_ALWAYSINLINE solve_rmq_wand_inline(uint64_t docid, int l, int r,
                                                topk_rmq_heap& heap)
     {
@@ -385,13 +508,38 @@ protected:
             return;
 
         auto en = m_index.sequence_at(offset);
-        return detail::do_enumerator_intersection(en, l, r, heap, m_ranking);
+        return detail::do_enumerator_intersection(en, l, r, heap, m_ranking, m_buffer);
+    }
+
+    void PS_ALWAYSINLINE solve_asindex_inline(uint64_t docid, int l, int r, topk_heap& heap,
+                                              std::vector<uint64_t>& buffer)
+    {
+        uint64_t offset;
+        if (!m_index.get_offset(docid, offset))
+            return;
+
+        auto en = m_index.sequence_at(offset);
+        return detail::do_enumerator_intersection(en, l, r, heap, m_ranking, buffer);
     }
 
     const Index& m_index;
     const std::vector<uint64_t>& m_ranking;
     const std::vector<uint64_t>& m_wand;
     int m_k;
+
+    // Scratch space for extract_range, reused across queries
+    std::vector<uint64_t> m_buffer;
+
+    // Scratch space of the chunks of a hub query
+    struct chunk {
+        std::vector<ranked_docid> hits;
+        std::vector<ranked_docid> docids;
+        std::vector<uint64_t> buffer;
+    };
+
+    hub_split m_split;
+    std::vector<chunk> m_chunks;
+    std::vector<ranked_docid> m_merged;
 };
 
 #define LOOP_BODY(R, DATA, T)                                                \
@@ -403,6 +551,7 @@ void solver<BOOST_PP_CAT(indices::T, _index), Schemes::topk_hopping>::solve( \
 }
 
 BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SIMPLE_INDEX_TYPES);
+BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_COVERAGE_INDEX_TYPES);
 #undef LOOP_BODY
 
 #define LOOP_BODY(R, DATA, T)                                                     \
@@ -414,6 +563,7 @@ void solver<BOOST_PP_CAT(indices::T, _index), Schemes::topk_hopping_wand>::solve
 }
 
 BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SIMPLE_INDEX_TYPES);
+BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_COVERAGE_INDEX_TYPES);
 #undef LOOP_BODY
 
 // RMQ is only defined for topk indices
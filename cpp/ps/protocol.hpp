@@ -0,0 +1,261 @@
+#pragma once
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include "ps/coding.hpp"
+
+namespace ps {
+namespace protocol {
+
+// Length prefixed binary frames, fixed width fields in little endian:
+//
+//   request   length u32 | id u64 | attribute u16 | scheme u8 | k u32 |
+//             user u64 | prefix bytes
+//   response  length u32 | id u64 | status u8 | l i32 | r i32 | count u32 |
+//             count docids u64 (or the error message if status != ok)
+//
+// length counts the bytes after itself. Clients can pipeline requests:
+// responses carry the id of their request and come back in completion
+// order, not in request order. The docids of a response are written
+// straight from the result vector of the server, and can be read straight
+// into the one of the client.
+static const size_t request_header_size = 8 + 2 + 1 + 4 + 8;
+static const size_t response_header_size = 8 + 1 + 4 + 4 + 4;
+static const size_t max_frame_size = 1 << 30;
+
+enum status : uint8_t {
+    ok = 0,
+    error = 1,
+};
+
+struct request {
+    uint64_t id;
+    uint16_t attribute;
+    uint8_t scheme;
+    uint32_t k;
+    uint64_t user;
+    std::string prefix;
+};
+
+struct response {
+    uint64_t id;
+    uint8_t status;
+    int32_t l;
+    int32_t r;
+    std::vector<uint64_t> docids;
+    std::string error;
+};
+
+inline void encode_request(std::string& out, const request& req)
+{
+    char buf[4 + request_header_size];
+    coding::encode_fixed_32(buf, request_header_size + req.prefix.size());
+    coding::encode_fixed_64(buf + 4, req.id);
+    buf[12] = char(req.attribute & 0xff);
+    buf[13] = char(req.attribute >> 8);
+    buf[14] = char(req.scheme);
+    coding::encode_fixed_32(buf + 15, req.k);
+    coding::encode_fixed_64(buf + 19, req.user);
+
+    out.append(buf, sizeof(buf));
+    out.append(req.prefix);
+}
+
+// body is a frame without its length
+inline bool decode_request(const char* body, size_t size, request& req)
+{
+    if (size < request_header_size)
+        return false;
+
+    req.id = coding::decode_fixed_64(body);
+    req.attribute = uint16_t(uint8_t(body[8])) | uint16_t(uint8_t(body[9])) << 8;
+    req.scheme = uint8_t(body[10]);
+    req.k = coding::decode_fixed_32(body + 11);
+    req.user = coding::decode_fixed_64(body + 15);
+    req.prefix.assign(body + request_header_size, size - request_header_size);
+    return true;
+}
+
+// Fills the length and header of a response whose payload is payload_bytes
+// long, buf must hold 4 + response_header_size bytes
+inline void encode_response_header(char* buf, uint64_t id, uint8_t status,
+                                   int32_t l, int32_t r, uint32_t count,
+                                   size_t payload_bytes)
+{
+    coding::encode_fixed_32(buf, response_header_size + payload_bytes);
+    coding::encode_fixed_64(buf + 4, id);
+    buf[12] = char(status);
+    coding::encode_fixed_32(buf + 13, uint32_t(l));
+    coding::encode_fixed_32(buf + 17, uint32_t(r));
+    coding::encode_fixed_32(buf + 21, count);
+}
+
+// Blocking I/O on a socket, false once the peer is gone
+inline bool read_full(int fd, char* buf, size_t n)
+{
+    while (n) {
+        ssize_t got = ::read(fd, buf, n);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        buf += got;
+        n -= got;
+    }
+    return true;
+}
+
+inline bool write_full(int fd, struct iovec* iov, int iovcnt)
+{
+    while (iovcnt) {
+        ssize_t put = ::writev(fd, iov, iovcnt);
+        if (put < 0 && errno == EINTR)
+            continue;
+        if (put <= 0)
+            return false;
+
+        while (iovcnt && size_t(put) >= iov->iov_len) {
+            put -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + put;
+            iov->iov_len -= put;
+        }
+    }
+    return true;
+}
+
+// Addresses are either the path of a Unix domain socket or tcp:<port> for
+// loopback TCP
+inline int open_socket(const std::string& address, bool listening)
+{
+    int fd;
+
+    if (address.compare(0, 4, "tcp:") == 0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(std::stoi(address.substr(4)));
+
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error("Unable to create socket");
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (listening)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        struct sockaddr* sa = reinterpret_cast<struct sockaddr*>(&addr);
+        if (listening ? ::bind(fd, sa, sizeof(addr)) : ::connect(fd, sa, sizeof(addr))) {
+            ::close(fd);
+            throw std::runtime_error("Unable to open " + address + ": " + strerror(errno));
+        }
+    } else {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (address.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("Socket path too long");
+        strcpy(addr.sun_path, address.c_str());
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw std::runtime_error("Unable to create socket");
+
+        if (listening)
+            ::unlink(address.c_str());
+
+        struct sockaddr* sa = reinterpret_cast<struct sockaddr*>(&addr);
+        if (listening ? ::bind(fd, sa, sizeof(addr)) : ::connect(fd, sa, sizeof(addr))) {
+            ::close(fd);
+            throw std::runtime_error("Unable to open " + address + ": " + strerror(errno));
+        }
+    }
+
+    if (listening && ::listen(fd, 128)) {
+        ::close(fd);
+        throw std::runtime_error("Unable to listen on " + address);
+    }
+
+    return fd;
+}
+
+// Blocking client, send() and receive() can be called from two different
+// threads to keep requests in flight
+class client : boost::noncopyable {
+public:
+    client(const std::string& address)
+        : m_fd(open_socket(address, false))
+    {}
+
+    ~client()
+    {
+        ::close(m_fd);
+    }
+
+    void send(const request& req)
+    {
+        m_out.clear();
+        encode_request(m_out, req);
+
+        struct iovec iov = {&m_out[0], m_out.size()};
+        if (!write_full(m_fd, &iov, 1))
+            throw std::runtime_error("Connection closed");
+    }
+
+    // Reads the next response, whichever request it answers
+    void receive(response& res)
+    {
+        char header[4 + response_header_size];
+        if (!read_full(m_fd, header, sizeof(header)))
+            throw std::runtime_error("Connection closed");
+
+        uint32_t length = coding::decode_fixed_32(header);
+        if (length < response_header_size || length > max_frame_size)
+            throw std::runtime_error("Malformed response");
+
+        res.id = coding::decode_fixed_64(header + 4);
+        res.status = uint8_t(header[12]);
+        res.l = int32_t(coding::decode_fixed_32(header + 13));
+        res.r = int32_t(coding::decode_fixed_32(header + 17));
+        uint32_t count = coding::decode_fixed_32(header + 21);
+        size_t payload = length - response_header_size;
+
+        bool read;
+        if (res.status == ok) {
+            if (payload != count * sizeof(uint64_t))
+                throw std::runtime_error("Malformed response");
+            res.docids.resize(count);
+            res.error.clear();
+            read = read_full(m_fd, reinterpret_cast<char*>(res.docids.data()), payload);
+        } else {
+            res.docids.clear();
+            res.error.resize(payload);
+            read = read_full(m_fd, &res.error[0], payload);
+        }
+
+        if (!read)
+            throw std::runtime_error("Connection closed");
+    }
+
+private:
+    int m_fd;
+    std::string m_out;
+};
+
+}
+}
@@ -12,9 +12,15 @@
 
 #include <boost/lexical_cast.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <thread>
 #include <sstream>
 #include <queue>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
 
 #include "ps/utils.hpp"
 #include "ps/configuration.hpp"
@@ -60,6 +66,16 @@ protected:
 };
 
 
+// Runs prepare() on a fixed pool of worker threads and commits the jobs in
+// the order they were added.
+//
+// Jobs are grouped in batches of about work_per_thread expected work, and
+// every batch gets a sequence number. Batches are dealt round robin to the
+// deques of the workers, and an idle worker steals from the others. A
+// prepared batch waits in a reorder buffer until all the batches before it
+// are committed; whichever worker completes the next batch in sequence
+// commits it and everything that was waiting behind it. add_job() blocks
+// while max_in_flight batches are not committed yet, which bounds memory.
 class ordered_queue : public queue {
 public:
     ordered_queue(double work_per_thread = configuration::get().work_per_thread,
@@ -68,22 +84,33 @@ public:
         : queue(work_per_thread, user_data, runner)
         , m_expected_work(0)
         , m_work_per_thread(work_per_thread)
-        , m_active_threads(0)
+        , m_next_worker(0)
+        , m_next_seq(0)
+        , m_next_commit(0)
         , m_committing(false)
+        , m_pending(0)
+        , m_shutdown(false)
     {
         m_max_threads = configuration::get().worker_threads;
+        m_max_in_flight = 4 * m_max_threads;
         logger() << "ordered queue using " << m_max_threads
                  << " worker threads (" << (int)work_per_thread
                  << " work per thread)" << std::endl;
+
+        for (size_t i = 0; i < m_max_threads; ++i)
+            m_workers.emplace_back(new worker());
+        for (size_t i = 0; i < m_max_threads; ++i)
+            m_threads.add_thread(new boost::thread(
+                boost::bind(&ordered_queue::thread_func, this, i)));
     }
 
     virtual void add_job(job_ptr_type j, double expected_work)
     {
         if (m_max_threads) {
-            m_next_thread.first.push_back(j);
+            m_next_batch.push_back(j);
             m_expected_work += expected_work;
             if (m_expected_work >= m_work_per_thread) {
-                spawn_next_thread();
+                submit_batch();
             }
         } else { // all in main thread
             j->prepare(m_user_data);
@@ -95,83 +122,162 @@ public:
     ~ordered_queue()
     {
         complete();
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_pool_mutex);
+            m_shutdown = true;
+        }
+
+        m_work_cond.notify_all();
+        m_threads.join_all();
     }
 
     virtual void complete()
     {
-        if (!m_next_thread.first.empty()) {
-            spawn_next_thread();
+        if (!m_next_batch.empty()) {
+            submit_batch();
         }
 
-        while (m_active_threads > 0) {
-            commit_thread();
-        }
-
-        if (m_committing)
-            wait_commit();
+        boost::unique_lock<boost::mutex> lock(m_commit_mutex);
+        while (m_next_commit < m_next_seq)
+            m_committed_cond.wait(lock);
     }
 
 private:
-    void spawn_next_thread()
-    {
-        if (m_active_threads >= m_max_threads)
-            commit_thread();
+    struct batch {
+        uint64_t seq;
+        job_list jobs;
+    };
 
-        m_running_threads.emplace_back();
-        std::swap(m_next_thread, m_running_threads.back());
+    typedef std::unique_ptr<batch> batch_ptr;
 
-        const job_list& cur_queue = m_running_threads.back().first;
-        m_active_threads++;
-        m_running_threads.back().second = boost::thread(
-            boost::bind(m_runner, m_user_data, cur_queue)
-        );
+    struct worker {
+        boost::mutex mutex;
+        std::deque<batch_ptr> batches;
+    };
+
+    void submit_batch()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(m_commit_mutex);
+            while (m_next_seq - m_next_commit >= m_max_in_flight)
+                m_committed_cond.wait(lock);
+        }
 
+        batch_ptr b(new batch());
+        b->seq = m_next_seq++;
+        b->jobs.swap(m_next_batch);
         m_expected_work = 0;
+
+        worker& w = *m_workers[m_next_worker];
+        m_next_worker = (m_next_worker + 1) % m_workers.size();
+        {
+            boost::lock_guard<boost::mutex> lock(w.mutex);
+            w.batches.push_back(std::move(b));
+        }
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_pool_mutex);
+            m_pending++;
+        }
+        m_work_cond.notify_one();
     }
 
-    static void commit_thread_main(void * user_data, std::vector<job_ptr_type>& queue)
+    // Own deque from the front, the others from the back
+    batch_ptr take_batch(size_t id)
     {
-        for (auto& j: queue) {
-            j->commit(user_data);
-            j.reset();
+        for (;;) {
+            for (size_t i = 0; i < m_workers.size(); ++i) {
+                worker& w = *m_workers[(id + i) % m_workers.size()];
+                boost::lock_guard<boost::mutex> lock(w.mutex);
+                if (w.batches.empty())
+                    continue;
+
+                batch_ptr b;
+                if (i == 0) {
+                    b = std::move(w.batches.front());
+                    w.batches.pop_front();
+                } else {
+                    b = std::move(w.batches.back());
+                    w.batches.pop_back();
+                }
+                return b;
+            }
         }
     }
 
-    void wait_commit()
+    void thread_func(size_t id)
     {
-        m_commit_thread.join();
-
-        if (m_committing)
-            m_running_threads.pop_front();
+        for (;;) {
+            {
+                boost::unique_lock<boost::mutex> lock(m_pool_mutex);
+                while (!m_pending && !m_shutdown)
+                    m_work_cond.wait(lock);
+                if (!m_pending)
+                    return;
+                // one reserved batch is in some deque, maybe not found at
+                // the first pass if another worker is scanning too
+                m_pending--;
+            }
 
-        m_committing = false;
+            batch_ptr b = take_batch(id);
+            m_runner(m_user_data, b->jobs);
+            commit_in_order(std::move(b));
+        }
     }
 
-    void commit_thread()
+    void commit_in_order(batch_ptr b)
     {
-        assert(m_active_threads > 0);
-        wait_commit();
-
-        m_running_threads.front().second.join();
-        m_active_threads--;
+        boost::unique_lock<boost::mutex> lock(m_commit_mutex);
+        uint64_t seq = b->seq;
+        m_reorder.emplace(seq, std::move(b));
+        if (m_committing)
+            return;
 
-        std::vector<job_ptr_type>& queue = m_running_threads.front().first;
         m_committing = true;
-        m_commit_thread = boost::thread(
-            ordered_queue::commit_thread_main, m_user_data, queue
-        );
-    }
+        for (;;) {
+            auto it = m_reorder.find(m_next_commit);
+            if (it == m_reorder.end())
+                break;
+
+            batch_ptr next = std::move(it->second);
+            m_reorder.erase(it);
+
+            lock.unlock();
+            for (auto& j: next->jobs) {
+                j->commit(m_user_data);
+                j.reset();
+            }
+            next.reset();
+            lock.lock();
 
-    typedef std::pair<std::vector<job_ptr_type>, boost::thread> thread_t;
-    thread_t m_next_thread;
-    std::deque<thread_t> m_running_threads;
+            m_next_commit++;
+            m_committed_cond.notify_all();
+        }
+        m_committing = false;
+    }
 
+    job_list m_next_batch;
     size_t m_expected_work;
     double m_work_per_thread;
     size_t m_max_threads;
-    size_t m_active_threads;
+    size_t m_max_in_flight;
+
+    std::vector<std::unique_ptr<worker>> m_workers;
+    boost::thread_group m_threads;
+    size_t m_next_worker;
+
+    uint64_t m_next_seq;
+    uint64_t m_next_commit;
+    std::map<uint64_t, batch_ptr> m_reorder;
     bool m_committing;
-    boost::thread m_commit_thread;
+    boost::mutex m_commit_mutex;
+    boost::condition_variable m_committed_cond;
+
+    size_t m_pending;
+    bool m_shutdown;
+    boost::mutex m_pool_mutex;
+    boost::condition_variable m_work_cond;
 };
 
 class unordered_multi_queue : public queue {
@@ -472,6 +578,367 @@ private:
     thread_exception_handler handle_thread_exception;
 };
 
+// Bounded multi-producer multi-consumer ring buffer (Vyukov). Every cell
+// carries a sequence number telling whether it is ready to be written or
+// read at the current lap, so producers and consumers only contend on the
+// position they claim with a compare-and-swap.
+template <typename T>
+class mpmc_ring : boost::noncopyable {
+public:
+    mpmc_ring(size_t capacity)
+        : m_mask(ceil_pow2(capacity) - 1)
+        , m_cells(new cell[m_mask + 1])
+        , m_enqueue_pos(0)
+        , m_dequeue_pos(0)
+    {
+        for (size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool try_push(T& value)
+    {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = m_cells[pos & m_mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(value);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value)
+    {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = m_cells[pos & m_mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(c.value);
+                    c.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool empty() const
+    {
+        return m_dequeue_pos.load() >= m_enqueue_pos.load();
+    }
+
+private:
+    struct cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    static size_t ceil_pow2(size_t n)
+    {
+        size_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    const size_t m_mask;
+    std::unique_ptr<cell[]> m_cells;
+    // producers and consumers on different cache lines
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueue_pos;
+    char m_pad1[64];
+    std::atomic<size_t> m_dequeue_pos;
+};
+
+// Unordered queue for many small jobs. Jobs go through an mpmc_ring, so
+// adding and taking a job costs a compare-and-swap rather than a few mutexes.
+// An idle worker spins for a while before parking on a condition variable,
+// and prepared jobs are committed commit_batch at a time (or when the worker
+// runs out of work), so the commit lock is taken once per batch. add_job()
+// spins while the ring is full.
+class unordered_ring_queue : public queue {
+public:
+    static const size_t commit_batch = 64;
+    static const size_t spin_rounds = 1 << 10;
+
+    unordered_ring_queue(double work_per_thread = configuration::get().work_per_thread,
+                         void* user_data = nullptr,
+                         thread_func runner = thread_main)
+        : queue(work_per_thread, user_data, runner)
+        , m_ring(std::max<size_t>(1024, 64 * configuration::get().worker_threads))
+        , m_outstanding(0)
+        , m_parked(0)
+        , m_shutdown(false)
+    {
+        size_t max_threads = configuration::get().worker_threads;
+        logger() << "not ordered ring queue using " << max_threads
+                 << " worker threads" << std::endl;
+
+        for (size_t i = 0; i < max_threads; ++i)
+            m_threads.add_thread(new boost::thread(
+                boost::bind(&unordered_ring_queue::thread_func, this)));
+    }
+
+    ~unordered_ring_queue()
+    {
+        complete();
+
+        m_shutdown = true;
+        {
+            boost::lock_guard<boost::mutex> lock(m_park_mutex);
+            m_work_cond.notify_all();
+        }
+        m_threads.join_all();
+    }
+
+    virtual void add_job(job_ptr_type j, double /*expected_work*/)
+    {
+        if (m_threads.size() == 0) { // all in main thread
+            j->prepare(m_user_data);
+            j->commit(m_user_data);
+            return;
+        }
+
+        m_outstanding++;
+        for (size_t spins = 0; !m_ring.try_push(j); ++spins) {
+            if (spins >= spin_rounds)
+                boost::this_thread::yield();
+        }
+
+        if (m_parked.load() > 0) {
+            boost::lock_guard<boost::mutex> lock(m_park_mutex);
+            m_work_cond.notify_one();
+        }
+    }
+
+    virtual void complete()
+    {
+        boost::unique_lock<boost::mutex> lock(m_park_mutex);
+        while (m_outstanding.load() > 0)
+            m_done_cond.wait(lock);
+    }
+
+private:
+    void thread_func()
+    {
+        job_list current(1);
+        job_list prepared;
+        prepared.reserve(commit_batch);
+
+        for (;;) {
+            job_ptr_type j;
+            size_t spins = 0;
+            while (!m_ring.try_pop(j)) {
+                if (++spins < spin_rounds)
+                    continue;
+
+                // nothing to do: publish what we have, then sleep
+                commit(prepared);
+                if (!park())
+                    return;
+                spins = 0;
+            }
+
+            current[0] = std::move(j);
+            m_runner(m_user_data, current);
+            prepared.push_back(std::move(current[0]));
+
+            if (prepared.size() >= commit_batch)
+                commit(prepared);
+        }
+    }
+
+    // Returns false on shutdown. The parked counter is raised before the
+    // ring is checked and add_job() pushes before reading it, so either the
+    // worker sees the job or the producer sees the worker.
+    bool park()
+    {
+        boost::unique_lock<boost::mutex> lock(m_park_mutex);
+        m_parked++;
+        while (m_ring.empty() && !m_shutdown)
+            m_work_cond.wait(lock);
+        m_parked--;
+
+        return !m_shutdown || !m_ring.empty();
+    }
+
+    void commit(job_list& prepared)
+    {
+        if (prepared.empty())
+            return;
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_commit_mutex);
+            for (auto& j: prepared)
+                j->commit(m_user_data);
+        }
+
+        size_t n = prepared.size();
+        prepared.clear();
+        if (m_outstanding.fetch_sub(n) == n) {
+            boost::lock_guard<boost::mutex> lock(m_park_mutex);
+            m_done_cond.notify_all();
+        }
+    }
+
+    mpmc_ring<job_ptr_type> m_ring;
+    boost::thread_group m_threads;
+
+    std::atomic<size_t> m_outstanding;
+    std::atomic<size_t> m_parked;
+    std::atomic<bool> m_shutdown;
+    boost::mutex m_park_mutex;
+    boost::condition_variable m_work_cond;
+    boost::condition_variable m_done_cond;
+
+    boost::mutex m_commit_mutex;
+};
+
+// Fork-join pool for the chunks of a single query. run() publishes a group of
+// n tasks and works on it from the calling thread; idle workers of the pool
+// join the oldest running group and claim its remaining tasks one at a time,
+// so a slow chunk does not hold back the others. run() returns once every
+// task of its group is done. Several groups, from different callers, can be
+// running at once. With no worker threads the tasks run in the caller.
+class task_pool : boost::noncopyable {
+public:
+    typedef std::function<void(size_t)> task;
+
+    explicit task_pool(size_t threads)
+        : m_shutdown(false)
+    {
+        for (size_t i = 0; i < threads; ++i)
+            m_threads.add_thread(new boost::thread(
+                boost::bind(&task_pool::thread_func, this)));
+    }
+
+    // Shared by all the solvers, see PS_SOLVERS_PARALLEL_THREADS
+    static task_pool& shared()
+    {
+        static task_pool pool(configuration::get().solvers_parallel_threads);
+        return pool;
+    }
+
+    ~task_pool()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            m_shutdown = true;
+        }
+
+        m_work_cond.notify_all();
+        m_threads.join_all();
+    }
+
+    size_t num_threads() const
+    {
+        return m_threads.size();
+    }
+
+    void run(size_t n, const task& t)
+    {
+        if (n == 1 || !num_threads()) {
+            for (size_t i = 0; i < n; ++i)
+                t(i);
+            return;
+        }
+
+        group g(n, t);
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+            m_groups.push_back(&g);
+        }
+        m_work_cond.notify_all();
+
+        while (run_one(g));
+
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        remove(g);
+        while (g.done != n || g.helpers)
+            m_done_cond.wait(lock);
+    }
+
+private:
+    struct group {
+        group(size_t n, const task& t)
+            : n(n)
+            , t(t)
+            , next(0)
+            , done(0)
+            , helpers(0)
+        {}
+
+        size_t n;
+        const task& t;
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        size_t helpers; // under m_mutex
+    };
+
+    bool run_one(group& g)
+    {
+        size_t i = g.next++;
+        if (i >= g.n)
+            return false;
+
+        g.t(i);
+        g.done++;
+        return true;
+    }
+
+    void remove(group& g)
+    {
+        auto it = std::find(m_groups.begin(), m_groups.end(), &g);
+        if (it != m_groups.end())
+            m_groups.erase(it);
+    }
+
+    void thread_func()
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        for (;;) {
+            while (m_groups.empty() && !m_shutdown)
+                m_work_cond.wait(lock);
+            if (m_groups.empty())
+                return;
+
+            group& g = *m_groups.front();
+            g.helpers++;
+            lock.unlock();
+
+            while (run_one(g));
+
+            lock.lock();
+            // no task left to claim, whoever comes next skips the group
+            remove(g);
+            g.helpers--;
+            m_done_cond.notify_all();
+        }
+    }
+
+    std::deque<group*> m_groups;
+    bool m_shutdown;
+    boost::mutex m_mutex;
+    boost::condition_variable m_work_cond;
+    boost::condition_variable m_done_cond;
+    boost::thread_group m_threads;
+};
+
 queue* new_queue(void* user_data = nullptr, thread_func runner = thread_main)
 {
     const std::string& impl = configuration::get().queue_impl;
@@ -481,6 +948,8 @@ queue* new_queue(void* user_data = nullptr, thread_func runner = thread_main)
         return new unordered_single_queue(work_per_thread, user_data, runner);
     if (impl == "unordered_multi")
         return new unordered_multi_queue(work_per_thread, user_data, runner);
+    if (impl == "unordered_ring")
+        return new unordered_ring_queue(work_per_thread, user_data, runner);
 
     return new ordered_queue(work_per_thread, user_data, runner);
 }
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "ps/utils.hpp"
+#include "ps/sequences/options.hpp"
+
+namespace ps {
+namespace sequences {
+
+// Roaring-style layout: docids are split into chunks of 2^16 by their high
+// bits. A chunk holding more than array_max elements is stored as a 2^16 bit
+// bitmap, the others as a sorted array of 16-bit lows.
+//
+//   n (4 bytes) | chunks (4 bytes)
+//   chunks + 1 directory entries: key, rank of the first element, payload offset
+//   payloads
+//
+// The last directory entry only carries the total rank n.
+class bitmap_seq {
+public:
+    static const uint64_t chunk_bits = 16;
+    static const uint64_t chunk_size = 1 << chunk_bits;
+    static const uint64_t chunk_words = chunk_size / 64;
+    static const uint64_t array_max = 4096;
+    static const uint64_t entry_size = 12;
+
+    bitmap_seq(const char *data, uint64_t data_size, options opts)
+        : m_data(reinterpret_cast<const uint8_t *>(data))
+        , m_universe(opts.universe)
+    {}
+
+    template<typename DocsIterator>
+    static void serialize(std::string& output,
+                          options opts,
+                          uint64_t n,
+                          DocsIterator docs_begin)
+    {
+        std::vector<uint32_t> directory;
+        std::vector<uint8_t> payload;
+        std::vector<uint16_t> lows;
+        uint64_t key = 0;
+
+        DocsIterator docs_it(docs_begin);
+        for (uint64_t i = 0; i <= n; ++i) {
+            uint64_t doc = (i < n) ? uint64_t(*docs_it++) : 0;
+
+            if (!lows.empty() && (i == n || (doc >> chunk_bits) != key)) {
+                directory.push_back(key);
+                directory.push_back(i - lows.size());
+                directory.push_back(payload.size());
+                write_chunk(lows, payload);
+                lows.clear();
+            }
+
+            if (i < n) {
+                key = doc >> chunk_bits;
+                lows.push_back(doc & (chunk_size - 1));
+            }
+        }
+
+        uint32_t chunks = directory.size() / 3;
+        directory.push_back(0);
+        directory.push_back(n);
+        directory.push_back(payload.size());
+
+        output.resize(8 + directory.size() * 4 + payload.size());
+        uint8_t* p = reinterpret_cast<uint8_t*>(&output[0]);
+        *((uint32_t*)p) = n;
+        *((uint32_t*)(p + 4)) = chunks;
+        std::copy(directory.begin(), directory.end(), (uint32_t*)(p + 8));
+        std::copy(payload.begin(), payload.end(), p + 8 + directory.size() * 4);
+    }
+
+    class enumerator;
+
+    const char* data() const
+    {
+        return reinterpret_cast<const char *>(m_data);
+    }
+
+    enumerator deserialize_at(size_t offset) const
+    {
+        return enumerator(m_data + offset, m_universe);
+    }
+
+    class enumerator {
+    public:
+        enumerator(uint8_t const* data, uint64_t universe)
+            : m_n(*((uint32_t const*)data))
+            , m_chunks(*((uint32_t const*)(data + 4)))
+            , m_directory(data + 8)
+            , m_payload(m_directory + entry_size * (m_chunks + 1))
+            , m_universe(universe)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            load_chunk(0);
+        }
+
+        void PS_ALWAYSINLINE next()
+        {
+            if (PS_UNLIKELY(++m_pos == m_chunk_end)) {
+                load_chunk(m_chunk + 1);
+                return;
+            }
+
+            if (!m_bitmap)
+                m_cur_docid = m_base + lows()[m_pos - m_chunk_begin];
+            else
+                m_cur_docid = m_base + next_set_bit(words(), m_cur_docid - m_base + 1);
+        }
+
+        void next_geq(uint64_t lower_bound)
+        {
+            if (lower_bound <= m_cur_docid)
+                return;
+
+            uint64_t key = lower_bound >> chunk_bits;
+            if (key != (m_base >> chunk_bits)) {
+                uint32_t lo = m_chunk + 1, hi = m_chunks;
+                while (lo < hi) {
+                    uint32_t mid = lo + (hi - lo) / 2;
+                    if (entry(mid, 0) < key)
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+
+                load_chunk(lo);
+                if (lo >= m_chunks || entry(lo, 0) > key)
+                    return;
+            }
+
+            seek_in_chunk(lower_bound - m_base);
+        }
+
+        void move(uint64_t pos)
+        {
+            if (PS_UNLIKELY(pos >= m_n)) {
+                set_end();
+                return;
+            }
+
+            if (m_chunk == m_chunks || pos < m_chunk_begin || pos >= m_chunk_end) {
+                uint32_t lo = 0, hi = m_chunks - 1;
+                while (lo < hi) {
+                    uint32_t mid = lo + (hi - lo + 1) / 2;
+                    if (entry(mid, 1) <= pos)
+                        lo = mid;
+                    else
+                        hi = mid - 1;
+                }
+                load_chunk(lo);
+            }
+
+            uint64_t rank = pos - m_chunk_begin;
+            m_pos = pos;
+
+            if (!m_bitmap) {
+                m_cur_docid = m_base + lows()[rank];
+                return;
+            }
+
+            uint64_t const* w = words();
+            for (uint64_t i = 0; ; ++i) {
+                uint64_t count = __builtin_popcountll(w[i]);
+                if (rank < count) {
+                    uint64_t word = w[i];
+                    for (; rank; --rank)
+                        word &= word - 1;
+                    m_cur_docid = m_base + i * 64 + __builtin_ctzll(word);
+                    return;
+                }
+                rank -= count;
+            }
+        }
+
+        // Appends the elements in [l, r) to out and leaves the enumerator on
+        // the first element >= r. Bitmap chunks are scanned a word at a time.
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            if (m_cur_docid < l)
+                next_geq(l);
+
+            while (m_pos < m_n && m_cur_docid < r) {
+                if (!m_bitmap) {
+                    uint16_t const* a = lows();
+                    uint64_t i = m_pos - m_chunk_begin;
+                    uint64_t size = m_chunk_end - m_chunk_begin;
+
+                    while (i < size && m_base + a[i] < r)
+                        out.push_back(m_base + a[i++]);
+
+                    if (i == size) {
+                        load_chunk(m_chunk + 1);
+                        continue;
+                    }
+
+                    m_pos = m_chunk_begin + i;
+                    m_cur_docid = m_base + a[i];
+                    return;
+                }
+
+                uint64_t const* w = words();
+                uint64_t low = m_cur_docid - m_base;
+                uint64_t high = (r - m_base < chunk_size) ? r - m_base : chunk_size;
+                uint64_t last = (high + 63) / 64;
+
+                for (uint64_t i = low / 64; i < last; ++i) {
+                    uint64_t word = w[i];
+                    if (i == low / 64)
+                        word &= ~0ULL << (low % 64);
+                    if (i == last - 1 && (high % 64))
+                        word &= (1ULL << (high % 64)) - 1;
+
+                    for (; word; word &= word - 1, ++m_pos)
+                        out.push_back(m_base + i * 64 + __builtin_ctzll(word));
+                }
+
+                if (m_pos == m_chunk_end) {
+                    load_chunk(m_chunk + 1);
+                    continue;
+                }
+
+                m_cur_docid = m_base + next_set_bit(w, high);
+                return;
+            }
+        }
+
+        uint64_t docid() const
+        {
+            return m_cur_docid;
+        }
+
+        uint64_t position() const
+        {
+            return m_pos;
+        }
+
+        uint64_t size() const
+        {
+            return m_n;
+        }
+
+    private:
+        uint32_t entry(uint32_t chunk, uint32_t field) const
+        {
+            return ((uint32_t const*)(m_directory + entry_size * chunk))[field];
+        }
+
+        uint16_t const* lows() const
+        {
+            return (uint16_t const*)m_chunk_data;
+        }
+
+        uint64_t const* words() const
+        {
+            return (uint64_t const*)m_chunk_data;
+        }
+
+        // The chunk must hold a set bit at or after from
+        static uint64_t PS_ALWAYSINLINE next_set_bit(uint64_t const* w, uint64_t from)
+        {
+            uint64_t i = from / 64;
+            uint64_t word = w[i] & (~0ULL << (from % 64));
+            while (!word)
+                word = w[++i];
+            return i * 64 + __builtin_ctzll(word);
+        }
+
+        // Set bits in [from, to), from < to
+        static uint64_t count_bits(uint64_t const* w, uint64_t from, uint64_t to)
+        {
+            uint64_t first = from / 64, last = to / 64;
+            if (first == last)
+                return __builtin_popcountll((w[first] >> (from % 64)) & ((1ULL << (to - from)) - 1));
+
+            uint64_t count = __builtin_popcountll(w[first] >> (from % 64));
+            for (uint64_t i = first + 1; i < last; ++i)
+                count += __builtin_popcountll(w[i]);
+            if (to % 64)
+                count += __builtin_popcountll(w[last] & ((1ULL << (to % 64)) - 1));
+            return count;
+        }
+
+        void seek_in_chunk(uint64_t low)
+        {
+            if (!m_bitmap) {
+                uint16_t const* a = lows();
+                uint16_t const* end = a + (m_chunk_end - m_chunk_begin);
+                uint16_t const* it = std::lower_bound(a + (m_pos - m_chunk_begin), end, low);
+
+                if (it == end) {
+                    load_chunk(m_chunk + 1);
+                    return;
+                }
+
+                m_pos = m_chunk_begin + (it - a);
+                m_cur_docid = m_base + *it;
+                return;
+            }
+
+            uint64_t skipped = count_bits(words(), m_cur_docid - m_base, low);
+            if (m_pos + skipped == m_chunk_end) {
+                load_chunk(m_chunk + 1);
+                return;
+            }
+
+            m_pos += skipped;
+            m_cur_docid = m_base + next_set_bit(words(), low);
+        }
+
+        void load_chunk(uint32_t chunk)
+        {
+            m_chunk = chunk;
+            if (PS_UNLIKELY(chunk >= m_chunks)) {
+                set_end();
+                return;
+            }
+
+            m_chunk_begin = entry(chunk, 1);
+            m_chunk_end = entry(chunk + 1, 1);
+            m_base = uint64_t(entry(chunk, 0)) << chunk_bits;
+            m_chunk_data = m_payload + entry(chunk, 2);
+            m_bitmap = (m_chunk_end - m_chunk_begin) > array_max;
+
+            m_pos = m_chunk_begin;
+            m_cur_docid = m_base + (m_bitmap ? next_set_bit(words(), 0) : lows()[0]);
+        }
+
+        void set_end()
+        {
+            m_chunk = m_chunks;
+            m_pos = m_n;
+            m_cur_docid = m_universe;
+        }
+
+        uint32_t m_n;
+        uint32_t m_chunks;
+        uint8_t const* m_directory;
+        uint8_t const* m_payload;
+        uint64_t m_universe;
+
+        uint32_t m_chunk;
+        uint64_t m_chunk_begin;
+        uint64_t m_chunk_end;
+        uint64_t m_base;
+        uint8_t const* m_chunk_data;
+        bool m_bitmap;
+
+        uint64_t m_pos;
+        uint64_t m_cur_docid;
+    };
+
+private:
+    static void write_chunk(const std::vector<uint16_t>& lows,
+                            std::vector<uint8_t>& payload)
+    {
+        size_t begin = payload.size();
+
+        if (lows.size() <= array_max) {
+            payload.resize(begin + lows.size() * 2);
+            std::copy(lows.begin(), lows.end(), (uint16_t*)&payload[begin]);
+            return;
+        }
+
+        payload.resize(begin + chunk_words * 8, 0);
+        uint64_t* w = (uint64_t*)&payload[begin];
+        for (uint16_t low : lows)
+            w[low / 64] |= 1ULL << (low % 64);
+    }
+
+    const uint8_t* m_data;
+    uint64_t m_universe;
+};
+
+}
+}
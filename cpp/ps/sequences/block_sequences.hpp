@@ -1,5 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+#include <immintrin.h>
 #include "block_codecs.hpp"
 #include "options.hpp"
 #include "util.hpp" // PEF
@@ -8,6 +13,107 @@
 namespace ps {
 namespace sequences {
 
+// Static B+-tree over the block maxima of long lists, with nodes of 16 keys
+// (one cache line). Level 1 holds the maximum of every group of 16 blocks,
+// level k + 1 the maximum of every 16 entries of level k, up to a level
+// that fits a single node. Levels are stored top first and padded to whole
+// nodes with uint32_t(-1); the block maxima themselves are the leaves.
+struct skip_directory {
+    static const uint64_t fanout = 16;
+    static const uint64_t max_levels = 8;
+    // Lists with fewer blocks keep the linear walk
+    static const uint64_t min_blocks = 64;
+
+    static bool enabled(uint64_t blocks)
+    {
+        return blocks >= min_blocks;
+    }
+
+    // Fills sizes[1..] with the number of entries of each level and returns
+    // the number of levels above the leaves
+    static uint64_t level_sizes(uint64_t blocks, uint64_t* sizes)
+    {
+        uint64_t levels = 0;
+        sizes[0] = blocks;
+        while (sizes[levels] > fanout) {
+            sizes[levels + 1] = (sizes[levels] + fanout - 1) / fanout;
+            ++levels;
+        }
+        return levels;
+    }
+
+    static uint64_t padded(uint64_t size)
+    {
+        return (size + fanout - 1) / fanout * fanout;
+    }
+
+    static uint64_t bytes(uint64_t blocks)
+    {
+        uint64_t sizes[max_levels + 1];
+        uint64_t levels = level_sizes(blocks, sizes);
+        uint64_t entries = 0;
+        for (uint64_t k = 1; k <= levels; ++k)
+            entries += padded(sizes[k]);
+        return 4 * entries;
+    }
+
+    static void build(uint32_t const* block_maxs, uint64_t blocks, uint8_t* out)
+    {
+        uint64_t sizes[max_levels + 1];
+        uint64_t levels = level_sizes(blocks, sizes);
+
+        std::vector<std::vector<uint32_t>> keys(levels + 1);
+        keys[0].assign(block_maxs, block_maxs + blocks);
+        for (uint64_t k = 1; k <= levels; ++k) {
+            keys[k].assign(padded(sizes[k]), uint32_t(-1));
+            for (uint64_t j = 0; j < sizes[k]; ++j) {
+                uint64_t last = std::min((j + 1) * fanout, sizes[k - 1]) - 1;
+                keys[k][j] = keys[k - 1][last];
+            }
+        }
+
+        for (uint64_t k = levels; k >= 1; --k) {
+            memcpy(out, keys[k].data(), 4 * keys[k].size());
+            out += 4 * keys[k].size();
+        }
+    }
+
+    // Returns the first block whose maximum is >= value, which must exist
+    static uint64_t search(uint8_t const* directory, uint32_t const* block_maxs,
+                           uint64_t blocks, uint32_t value)
+    {
+        uint64_t sizes[max_levels + 1];
+        uint64_t levels = level_sizes(blocks, sizes);
+
+        uint32_t const* level = (uint32_t const*)directory;
+        uint64_t node = 0;
+        for (uint64_t k = levels; k >= 1; --k) {
+            node = node * fanout + first_geq(level + node * fanout, value);
+            level += padded(sizes[k]);
+        }
+
+        // the leaf node may be partial, but the group maximum is >= value so
+        // the lanes past the last block are never reached
+        return node * fanout + first_geq(block_maxs + node * fanout, value);
+    }
+
+    // Index of the first of 16 sorted keys that is >= value
+    static uint64_t QS_ALWAYSINLINE first_geq(uint32_t const* keys, uint32_t value)
+    {
+        // SSE only has signed compares, flipping the sign bit keeps the
+        // unsigned order
+        const __m128i bias = _mm_set1_epi32(0x80000000);
+        const __m128i bound = _mm_set1_epi32(value ^ 0x80000000);
+        uint32_t lt = 0;
+        for (uint64_t i = 0; i < fanout; i += 4) {
+            __m128i x = _mm_xor_si128(_mm_loadu_si128((__m128i const*)(keys + i)), bias);
+            __m128i mask = _mm_cmplt_epi32(x, bound);
+            lt |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(mask))) << i;
+        }
+        return __builtin_ctz(~lt);
+    }
+};
+
 template <typename DocsSequence, typename DocsIterator>
 static void write(std::vector<uint8_t>& out, uint32_t n,
                   DocsIterator docs_begin) {
@@ -17,7 +123,9 @@ static void write(std::vector<uint8_t>& out, uint32_t n,
     uint64_t blocks = succinct::util::ceil_div(n, block_size);
     size_t begin_block_maxs = out.size();
     size_t begin_block_endpoints = begin_block_maxs + 4 * blocks;
-    size_t begin_blocks = begin_block_endpoints + 4 * (blocks - 1);
+    size_t begin_directory = begin_block_endpoints + 4 * (blocks - 1);
+    size_t begin_blocks = begin_directory
+        + (skip_directory::enabled(blocks) ? skip_directory::bytes(blocks) : 0);
     out.resize(begin_blocks);
 
     DocsIterator docs_it(docs_begin);
@@ -43,6 +151,11 @@ static void write(std::vector<uint8_t>& out, uint32_t n,
         }
         block_base = last_doc + 1;
     }
+
+    if (skip_directory::enabled(blocks)) {
+        skip_directory::build((uint32_t const*)&out[begin_block_maxs], blocks,
+                              &out[begin_directory]);
+    }
 }
 
 template <typename DocsSequence>
@@ -86,10 +199,11 @@ public:
             , m_blocks(succinct::util::ceil_div(m_n, DocsSequence::block_size))
             , m_block_maxs(m_base)
             , m_block_endpoints(m_block_maxs + 4 * m_blocks)
-            , m_blocks_data(m_block_endpoints + 4 * (m_blocks - 1))
+            , m_directory(m_block_endpoints + 4 * (m_blocks - 1))
+            , m_blocks_data(m_directory + (skip_directory::enabled(m_blocks)
+                                           ? skip_directory::bytes(m_blocks) : 0))
             , m_universe(universe)
         {
-            m_docs_buf.resize(DocsSequence::block_size);
             reset();
         }
 
@@ -104,7 +218,7 @@ public:
             if (QS_UNLIKELY(m_pos_in_block == m_cur_block_size)) {
                 if (m_cur_block + 1 == m_blocks) {
                     m_cur_docid = m_universe;
-                    m_cur_block_size = size() % DocsSequence::block_size;
+                    m_cur_block_size = size() - (m_blocks - 1) * DocsSequence::block_size;
                     m_pos_in_block = m_cur_block_size;
                     m_cur_block = m_blocks - 1;
                     return;
@@ -119,18 +233,27 @@ public:
         {
             assert(lower_bound >= m_cur_docid);
             if (QS_UNLIKELY(lower_bound > m_cur_block_max)) {
-                // binary search seems to perform worse here
+                // binary search seems to perform worse here, long lists go
+                // through the skip directory instead
                 if (lower_bound > block_max(m_blocks - 1)) {
                     m_cur_docid = m_universe;
-                    m_cur_block_size = size() % DocsSequence::block_size;
+                    m_cur_block_size = size() - (m_blocks - 1) * DocsSequence::block_size;
                     m_pos_in_block = m_cur_block_size;
                     m_cur_block = m_blocks - 1;
                     return;
                 }
 
                 uint64_t block = m_cur_block + 1;
-                while (block_max(block) < lower_bound) {
-                    ++block;
+                if (block_max(block) < lower_bound) {
+                    if (skip_directory::enabled(m_blocks)) {
+                        block = skip_directory::search(m_directory,
+                                                       (uint32_t const*)m_block_maxs,
+                                                       m_blocks, lower_bound);
+                    } else {
+                        while (block_max(block) < lower_bound) {
+                            ++block;
+                        }
+                    }
                 }
 
                 decode_docs_block(block);
@@ -142,6 +265,40 @@ public:
             }
         }
 
+        // Appends the elements in [l, r) to out and leaves the enumerator on
+        // the first element >= r. Blocks whose maximum is below r are
+        // flushed with a single prefix sum, the others are never decoded.
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            if (docid() < l)
+                next_geq(l);
+
+            while (position() < size() && m_cur_docid < r) {
+                if (QS_UNLIKELY(m_cur_block_max >= r)) {
+                    // the block holds an element >= r, so this stops in it
+                    while (m_cur_docid < r) {
+                        out.push_back(m_cur_docid);
+                        m_cur_docid += m_docs_buf[++m_pos_in_block] + 1;
+                    }
+                    return;
+                }
+
+                size_t base = out.size();
+                size_t n = m_cur_block_size - m_pos_in_block;
+                out.resize(base + n);
+
+                uint64_t doc = m_cur_docid;
+                out[base] = doc;
+                for (size_t i = 1; i < n; ++i) {
+                    doc += m_docs_buf[m_pos_in_block + i] + 1;
+                    out[base + i] = doc;
+                }
+
+                m_pos_in_block = m_cur_block_size - 1;
+                next();
+            }
+        }
+
         void QS_ALWAYSINLINE move(uint64_t pos)
         {
             uint64_t block = pos / DocsSequence::block_size;
@@ -207,6 +364,7 @@ public:
         uint32_t m_blocks;
         uint8_t const* m_block_maxs;
         uint8_t const* m_block_endpoints;
+        uint8_t const* m_directory;
         uint8_t const* m_blocks_data;
         uint64_t m_universe;
 
@@ -216,7 +374,8 @@ public:
         uint32_t m_cur_block_size;
         uint32_t m_cur_docid;
 
-        std::vector<uint32_t> m_docs_buf;
+        // Kept inline so that creating an enumerator never allocates
+        std::array<uint32_t, DocsSequence::block_size> m_docs_buf;
     };
 
 private:
@@ -0,0 +1,646 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include <immintrin.h>
+#include "block_codecs.hpp" // PEF
+#include "ps/utils.hpp"
+#include "ps/sequences/options.hpp"
+
+namespace ps {
+namespace sequences {
+namespace ef {
+
+// Samples are taken every 2^8 ones and zeros of the high bits. Most of our
+// lists are shorter than that and pay nothing for them.
+static const uint64_t log_sampling = 8;
+
+inline uint64_t PS_ALWAYSINLINE load_word(uint8_t const* p, uint64_t idx)
+{
+    uint64_t word;
+    memcpy(&word, p + idx * 8, sizeof(word));
+    return word;
+}
+
+inline uint64_t PS_ALWAYSINLINE select_in_word(uint64_t word, uint64_t k)
+{
+#ifdef __BMI2__
+    return __builtin_ctzll(_pdep_u64(1ULL << k, word));
+#else
+    for (; k; --k)
+        word &= word - 1;
+    return __builtin_ctzll(word);
+#endif
+}
+
+inline uint64_t msb(uint64_t x)
+{
+    return 63 - __builtin_clzll(x);
+}
+
+// Byte layout of an EF sequence of n values in [0, u):
+//   one samples | zero samples (uint32) | lower bits | upper bits
+struct layout {
+    layout(uint64_t n, uint64_t u, bool samples)
+        : n(n)
+        , l((n && u > n) ? msb(u / n) : 0)
+        , high_bits(n + (u >> l) + 1)
+        , one_samples(samples && n ? (n - 1) >> log_sampling : 0)
+        , zero_samples(samples ? (u >> l) >> log_sampling : 0)
+        , low_offset(4 * (one_samples + zero_samples))
+        , high_offset(low_offset + 8 * ((n * l + 63) / 64))
+        , bytes(high_offset + 8 * ((high_bits + 63) / 64))
+    {}
+
+    uint64_t n;
+    uint64_t l;
+    uint64_t high_bits;
+    uint64_t one_samples;
+    uint64_t zero_samples;
+    uint64_t low_offset;
+    uint64_t high_offset;
+    uint64_t bytes;
+};
+
+// Appends the values minus base, all in [0, u), to out
+template <typename DocsIterator>
+void write(std::vector<uint8_t>& out, DocsIterator begin, uint64_t n,
+           uint64_t base, uint64_t u, bool samples)
+{
+    layout lay(n, u, samples);
+    size_t start = out.size();
+    out.resize(start + lay.bytes, 0);
+    uint8_t* p = &out[start];
+
+    std::vector<uint64_t> low((n * lay.l + 63) / 64 + 1, 0);
+    std::vector<uint64_t> high((lay.high_bits + 63) / 64, 0);
+    uint64_t low_mask = (1ULL << lay.l) - 1;
+    uint64_t zeros = 0;
+
+    DocsIterator it(begin);
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t v = uint64_t(*it++) - base;
+
+        if (lay.l) {
+            uint64_t pos = i * lay.l;
+            low[pos / 64] |= (v & low_mask) << (pos % 64);
+            if (pos % 64 + lay.l > 64)
+                low[pos / 64 + 1] |= (v & low_mask) >> (64 - pos % 64);
+        }
+
+        uint64_t h = v >> lay.l;
+        uint64_t hp = h + i;
+        high[hp / 64] |= 1ULL << (hp % 64);
+
+        if (samples) {
+            if (i && !(i & ((1ULL << log_sampling) - 1)))
+                ((uint32_t*)p)[(i >> log_sampling) - 1] = hp;
+
+            // zero number z sits right before the first one of bucket z + 1
+            for (; zeros < h; ++zeros) {
+                if (zeros && !(zeros & ((1ULL << log_sampling) - 1)))
+                    ((uint32_t*)p)[lay.one_samples + (zeros >> log_sampling) - 1] = zeros + i;
+            }
+        }
+    }
+
+    if (samples) {
+        uint64_t last_zero = u >> lay.l;
+        for (; zeros <= last_zero; ++zeros) {
+            if (zeros && !(zeros & ((1ULL << log_sampling) - 1)))
+                ((uint32_t*)p)[lay.one_samples + (zeros >> log_sampling) - 1] = zeros + n;
+        }
+    }
+
+    memcpy(p + lay.low_offset, low.data(), lay.high_offset - lay.low_offset);
+    memcpy(p + lay.high_offset, high.data(), lay.bytes - lay.high_offset);
+}
+
+// Cursor over an EF sequence. Callers check position() < size() before
+// reading value().
+class cursor {
+public:
+    cursor()
+        : m_layout(0, 0, false)
+    {}
+
+    cursor(uint8_t const* data, uint64_t n, uint64_t u, bool samples)
+        : m_layout(n, u, samples)
+        , m_samples(data)
+        , m_low(data + m_layout.low_offset)
+        , m_high(data + m_layout.high_offset)
+    {
+        move(0);
+    }
+
+    void PS_ALWAYSINLINE next()
+    {
+        if (PS_UNLIKELY(++m_pos == m_layout.n))
+            return;
+
+        while (!m_high_word)
+            m_high_word = load_word(m_high, ++m_high_idx);
+
+        uint64_t hp = m_high_idx * 64 + __builtin_ctzll(m_high_word);
+        m_high_word &= m_high_word - 1;
+        m_value = ((hp - m_pos) << m_layout.l) | low(m_pos);
+    }
+
+    void move(uint64_t pos)
+    {
+        if (PS_UNLIKELY(pos >= m_layout.n)) {
+            m_pos = m_layout.n;
+            return;
+        }
+
+        uint64_t sample = pos >> log_sampling;
+        uint64_t from = sample ? ((uint32_t const*)m_samples)[sample - 1] : 0;
+        if (!m_layout.one_samples)
+            sample = 0, from = 0;
+
+        uint64_t hp = select(from, pos - (sample << log_sampling), false);
+        set_high(hp + 1);
+        m_pos = pos;
+        m_value = ((hp - pos) << m_layout.l) | low(pos);
+    }
+
+    // Requires lower_bound > value()
+    void next_geq(uint64_t lower_bound)
+    {
+        uint64_t h = lower_bound >> m_layout.l;
+
+        if (h > (m_value >> m_layout.l)) {
+            if (h > (m_layout.high_bits - m_layout.n - 1)) {
+                m_pos = m_layout.n;
+                return;
+            }
+
+            // the first element of bucket h follows zero number h - 1
+            uint64_t zero = h - 1;
+            uint64_t sample = zero >> log_sampling;
+            uint64_t from = sample ? ((uint32_t const*)m_samples)[m_layout.one_samples + sample - 1] : 0;
+            if (!m_layout.zero_samples)
+                sample = 0, from = 0;
+
+            uint64_t zp = select(from, zero - (sample << log_sampling), true);
+            set_high(zp + 1);
+            m_pos = zp - zero - 1; // next() moves to rank zp + 1 - h
+            next();
+        }
+
+        while (m_pos < m_layout.n && m_value < lower_bound)
+            next();
+    }
+
+    // Decodes up to k values starting from the current one into out,
+    // stopping before the first value >= bound. Returns the count.
+    uint64_t decode(uint64_t* out, uint64_t k, uint64_t bound)
+    {
+        uint64_t count = 0;
+        while (count < k && m_pos < m_layout.n && m_value < bound) {
+            out[count++] = m_value;
+            next();
+        }
+        return count;
+    }
+
+    uint64_t value() const
+    {
+        return m_value;
+    }
+
+    uint64_t position() const
+    {
+        return m_pos;
+    }
+
+    uint64_t size() const
+    {
+        return m_layout.n;
+    }
+
+private:
+    uint64_t PS_ALWAYSINLINE low(uint64_t i) const
+    {
+        uint64_t l = m_layout.l;
+        if (!l)
+            return 0;
+
+        uint64_t pos = i * l;
+        uint64_t value = load_word(m_low, pos / 64) >> (pos % 64);
+        if (pos % 64 + l > 64)
+            value |= load_word(m_low, pos / 64 + 1) << (64 - pos % 64);
+        return value & ((1ULL << l) - 1);
+    }
+
+    // Position of the k-th one (or zero) at or after from
+    uint64_t select(uint64_t from, uint64_t k, bool zeros) const
+    {
+        uint64_t idx = from / 64;
+        uint64_t word = load_word(m_high, idx);
+        if (zeros)
+            word = ~word;
+        word &= ~0ULL << (from % 64);
+
+        for (;;) {
+            uint64_t count = __builtin_popcountll(word);
+            if (k < count)
+                return idx * 64 + select_in_word(word, k);
+            k -= count;
+            word = load_word(m_high, ++idx);
+            if (zeros)
+                word = ~word;
+        }
+    }
+
+    // The next one is searched at or after pos
+    void PS_ALWAYSINLINE set_high(uint64_t pos)
+    {
+        m_high_idx = pos / 64;
+        m_high_word = load_word(m_high, m_high_idx) & (~0ULL << (pos % 64));
+    }
+
+    layout m_layout;
+    uint8_t const* m_samples;
+    uint8_t const* m_low;
+    uint8_t const* m_high;
+
+    uint64_t m_pos;
+    uint64_t m_value;
+    uint64_t m_high_idx;
+    uint64_t m_high_word;
+};
+
+}
+
+// Elias-Fano over the whole list with skip samples:
+//   n | u | ef::layout
+class native_ef_seq {
+public:
+    native_ef_seq(const char *data, uint64_t data_size, options opts)
+        : m_data(reinterpret_cast<const uint8_t *>(data))
+        , m_universe(opts.universe)
+    {}
+
+    template<typename DocsIterator>
+    static void serialize(std::string& output,
+                          options opts,
+                          uint64_t n,
+                          DocsIterator docs_begin)
+    {
+        std::vector<uint64_t> docs(n);
+        std::copy_n(docs_begin, n, docs.begin());
+        uint64_t u = n ? docs.back() + 1 : 0;
+
+        std::vector<uint8_t> out;
+        quasi_succinct::TightVariableByte::encode_single(n, out);
+        quasi_succinct::TightVariableByte::encode_single(u, out);
+        ef::write(out, docs.begin(), n, 0, u, true);
+
+        output.assign(reinterpret_cast<const char*>(out.data()), out.size());
+    }
+
+    class enumerator;
+
+    const char* data() const
+    {
+        return reinterpret_cast<const char *>(m_data);
+    }
+
+    enumerator deserialize_at(size_t offset) const
+    {
+        return enumerator(m_data + offset, m_universe);
+    }
+
+    class enumerator {
+    public:
+        enumerator(uint8_t const* data, uint64_t universe)
+            : m_universe(universe)
+        {
+            uint32_t n, u;
+            data = quasi_succinct::TightVariableByte::decode(data, &n, 1);
+            data = quasi_succinct::TightVariableByte::decode(data, &u, 1);
+            m_cursor = ef::cursor(data, n, u, true);
+        }
+
+        void reset()
+        {
+            m_cursor.move(0);
+        }
+
+        void PS_ALWAYSINLINE next()
+        {
+            m_cursor.next();
+        }
+
+        void next_geq(uint64_t lower_bound)
+        {
+            if (position() < size() && m_cursor.value() < lower_bound)
+                m_cursor.next_geq(lower_bound);
+        }
+
+        void move(uint64_t pos)
+        {
+            m_cursor.move(pos);
+        }
+
+        // Appends the elements in [l, r) to out, decoding them in batches
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            next_geq(l);
+
+            static const uint64_t batch = 64;
+            for (;;) {
+                size_t base = out.size();
+                out.resize(base + batch);
+                uint64_t count = m_cursor.decode(&out[base], batch, r);
+                out.resize(base + count);
+
+                if (count < batch)
+                    return;
+            }
+        }
+
+        uint64_t docid() const
+        {
+            return PS_LIKELY(position() < size()) ? m_cursor.value() : m_universe;
+        }
+
+        uint64_t position() const
+        {
+            return m_cursor.position();
+        }
+
+        uint64_t size() const
+        {
+            return m_cursor.size();
+        }
+
+    private:
+        uint64_t m_universe;
+        ef::cursor m_cursor;
+    };
+
+private:
+    const uint8_t* m_data;
+    uint64_t m_universe;
+};
+
+// Partitioned Elias-Fano with fixed size partitions. Each partition is coded
+// against the maximum of the previous one, and dense partitions holding
+// every id of their range take no space at all.
+//   n | partition maxima | partition endpoints | partitions
+class native_pef_seq {
+public:
+    static const uint64_t partition_size = 128;
+
+    native_pef_seq(const char *data, uint64_t data_size, options opts)
+        : m_data(reinterpret_cast<const uint8_t *>(data))
+        , m_universe(opts.universe)
+    {}
+
+    template<typename DocsIterator>
+    static void serialize(std::string& output,
+                          options opts,
+                          uint64_t n,
+                          DocsIterator docs_begin)
+    {
+        std::vector<uint64_t> docs(n);
+        std::copy_n(docs_begin, n, docs.begin());
+
+        std::vector<uint8_t> out;
+        quasi_succinct::TightVariableByte::encode_single(n, out);
+
+        uint64_t partitions = (n + partition_size - 1) / partition_size;
+        size_t begin_maxs = out.size();
+        size_t begin_endpoints = begin_maxs + 4 * partitions;
+        size_t begin_partitions = begin_endpoints + 4 * (partitions ? partitions - 1 : 0);
+        out.resize(begin_partitions);
+
+        uint64_t base = 0;
+        for (uint64_t p = 0; p < partitions; ++p) {
+            uint64_t first = p * partition_size;
+            uint64_t size = (n - first < partition_size) ? n - first : partition_size;
+            uint64_t max = docs[first + size - 1];
+
+            *((uint32_t*)&out[begin_maxs + 4 * p]) = max;
+            if (p)
+                *((uint32_t*)&out[begin_endpoints + 4 * (p - 1)]) = out.size() - begin_partitions;
+
+            if (max - base + 1 != size)
+                ef::write(out, docs.begin() + first, size, base, max - base + 1, false);
+
+            base = max + 1;
+        }
+
+        output.assign(reinterpret_cast<const char*>(out.data()), out.size());
+    }
+
+    class enumerator;
+
+    const char* data() const
+    {
+        return reinterpret_cast<const char *>(m_data);
+    }
+
+    enumerator deserialize_at(size_t offset) const
+    {
+        return enumerator(m_data + offset, m_universe);
+    }
+
+    class enumerator {
+    public:
+        enumerator(uint8_t const* data, uint64_t universe)
+            : m_universe(universe)
+        {
+            uint32_t n;
+            data = quasi_succinct::TightVariableByte::decode(data, &n, 1);
+            m_n = n;
+            m_partitions = (m_n + partition_size - 1) / partition_size;
+            m_maxs = data;
+            m_endpoints = m_maxs + 4 * m_partitions;
+            m_partitions_data = m_endpoints + 4 * (m_partitions ? m_partitions - 1 : 0);
+
+            reset();
+        }
+
+        void reset()
+        {
+            load_partition(0);
+        }
+
+        void PS_ALWAYSINLINE next()
+        {
+            if (PS_UNLIKELY(++m_pos_in_partition == m_partition_size)) {
+                load_partition(m_partition + 1);
+                return;
+            }
+
+            if (m_dense)
+                ++m_cur_docid;
+            else {
+                m_cursor.next();
+                m_cur_docid = m_base + m_cursor.value();
+            }
+        }
+
+        void next_geq(uint64_t lower_bound)
+        {
+            if (lower_bound <= m_cur_docid)
+                return;
+
+            if (lower_bound > partition_max(m_partition)) {
+                uint64_t p = m_partition + 1;
+                while (p < m_partitions && partition_max(p) < lower_bound)
+                    ++p;
+
+                load_partition(p);
+                if (p == m_partitions || lower_bound <= m_cur_docid)
+                    return;
+            }
+
+            if (m_dense) {
+                m_pos_in_partition += lower_bound - m_cur_docid;
+                m_cur_docid = lower_bound;
+            } else {
+                m_cursor.next_geq(lower_bound - m_base);
+                m_pos_in_partition = m_cursor.position();
+                m_cur_docid = m_base + m_cursor.value();
+            }
+        }
+
+        void move(uint64_t pos)
+        {
+            if (PS_UNLIKELY(pos >= m_n)) {
+                load_partition(m_partitions);
+                return;
+            }
+
+            uint64_t p = pos / partition_size;
+            if (p != m_partition)
+                load_partition(p);
+
+            m_pos_in_partition = pos % partition_size;
+            if (m_dense)
+                m_cur_docid = m_base + m_pos_in_partition;
+            else {
+                m_cursor.move(m_pos_in_partition);
+                m_cur_docid = m_base + m_cursor.value();
+            }
+        }
+
+        // Appends the elements in [l, r) to out. Partitions entirely below
+        // r are emitted in one go, dense ones without decoding anything.
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            next_geq(l);
+
+            while (position() < m_n && m_cur_docid < r) {
+                uint64_t stop = std::min(r, partition_max(m_partition) + 1);
+
+                if (m_dense) {
+                    for (uint64_t docid = m_cur_docid; docid < stop; ++docid)
+                        out.push_back(docid);
+                } else {
+                    size_t base = out.size();
+                    uint64_t left = m_partition_size - m_pos_in_partition;
+                    out.resize(base + left);
+                    uint64_t count = m_cursor.decode(&out[base], left, stop - m_base);
+                    for (size_t i = base; i < base + count; ++i)
+                        out[i] += m_base;
+                    out.resize(base + count);
+                }
+
+                if (stop <= partition_max(m_partition)) {
+                    // the range ends inside this partition
+                    if (m_dense) {
+                        m_pos_in_partition += stop - m_cur_docid;
+                        m_cur_docid = stop;
+                    } else {
+                        m_pos_in_partition = m_cursor.position();
+                        m_cur_docid = m_base + m_cursor.value();
+                    }
+                    return;
+                }
+
+                load_partition(m_partition + 1);
+            }
+        }
+
+        uint64_t docid() const
+        {
+            return m_cur_docid;
+        }
+
+        uint64_t position() const
+        {
+            return m_partition * partition_size + m_pos_in_partition;
+        }
+
+        uint64_t size() const
+        {
+            return m_n;
+        }
+
+    private:
+        uint64_t partition_max(uint64_t p) const
+        {
+            return ((uint32_t const*)m_maxs)[p];
+        }
+
+        void load_partition(uint64_t p)
+        {
+            m_partition = p;
+            m_pos_in_partition = 0;
+
+            if (PS_UNLIKELY(p >= m_partitions)) {
+                m_partition = m_partitions;
+                m_partition_size = 0;
+                m_cur_docid = m_universe;
+                if (m_n % partition_size) {
+                    // keep position() == size()
+                    m_partition = m_partitions - 1;
+                    m_pos_in_partition = m_n % partition_size;
+                }
+                return;
+            }
+
+            m_base = p ? partition_max(p - 1) + 1 : 0;
+            m_partition_size = (m_n - p * partition_size < partition_size)
+                ? m_n - p * partition_size : partition_size;
+            m_dense = (partition_max(p) - m_base + 1 == m_partition_size);
+
+            if (m_dense) {
+                m_cur_docid = m_base;
+                return;
+            }
+
+            uint32_t endpoint = p ? ((uint32_t const*)m_endpoints)[p - 1] : 0;
+            m_cursor = ef::cursor(m_partitions_data + endpoint, m_partition_size,
+                                  partition_max(p) - m_base + 1, false);
+            m_cur_docid = m_base + m_cursor.value();
+        }
+
+        uint64_t m_universe;
+        uint64_t m_n;
+        uint64_t m_partitions;
+        uint8_t const* m_maxs;
+        uint8_t const* m_endpoints;
+        uint8_t const* m_partitions_data;
+
+        uint64_t m_partition;
+        uint64_t m_partition_size;
+        uint64_t m_pos_in_partition;
+        uint64_t m_base;
+        bool m_dense;
+        uint64_t m_cur_docid;
+        ef::cursor m_cursor;
+    };
+
+private:
+    const uint8_t* m_data;
+    uint64_t m_universe;
+};
+
+}
+}
@@ -73,6 +73,24 @@ public:
             m_cur_docid = val.second;
         }
 
+        // Appends the elements in [l, r) to out and leaves the enumerator on
+        // the first element >= r. The start is found with a single select.
+        void QS_FLATTEN_FUNC extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            if (m_cur_docid < l)
+                next_geq(l);
+
+            uint64_t n = size();
+            auto val = std::make_pair(m_cur_pos, m_cur_docid);
+            while (val.first < n && val.second < r) {
+                out.push_back(val.second);
+                val = m_docs_enum.next();
+            }
+
+            m_cur_pos = val.first;
+            m_cur_docid = val.second;
+        }
+
         void QS_FLATTEN_FUNC move(uint64_t position)
         {
             auto val = m_docs_enum.move(position);
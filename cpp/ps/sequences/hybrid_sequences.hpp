@@ -0,0 +1,231 @@
+#pragma once
+
+#include <new>
+#include <string>
+#include "ps/sequences/block_sequences.hpp"
+#include "ps/sequences/elias_sequences.hpp"
+#include "ps/sequences/bitmap_sequences.hpp"
+
+#include "partitioned_sequence.hpp"
+
+namespace ps {
+namespace sequences {
+
+// Picks the codec per list at serialize() time. Every candidate encodes the
+// list and the smallest output wins, which in practice sends short lists to
+// varint, mid-size ones to optpfor, long ones to partitioned EF and hub
+// lists with dense 2^16 regions to bitmaps.
+// The choice is stored in a one byte tag in front of the payload.
+class hybrid_seq {
+public:
+    typedef block_seq<quasi_succinct::varint_G8IU_block> varint_type;
+    typedef block_seq<quasi_succinct::optpfor_block> optpfor_type;
+    typedef elias_seq<quasi_succinct::partitioned_sequence<>> pef_type;
+    typedef bitmap_seq bitmap_type;
+
+    enum codec : uint8_t {
+        codec_varint = 0,
+        codec_optpfor,
+        codec_pef,
+        codec_bitmap,
+        num_codecs
+    };
+
+    static const char* codec_name(uint8_t tag)
+    {
+        switch (tag) {
+        case codec_varint: return "block_varint";
+        case codec_optpfor: return "block_optpfor";
+        case codec_pef: return "opt";
+        case codec_bitmap: return "bitmap";
+        default: return "unknown";
+        }
+    }
+
+    hybrid_seq(const char *data, uint64_t data_size, options opts)
+        : m_data(data)
+        , m_varint(data, data_size, opts)
+        , m_optpfor(data, data_size, opts)
+        , m_pef(data, data_size, opts)
+        , m_bitmap(data, data_size, opts)
+    {}
+
+    template<typename DocsIterator>
+    static void serialize(std::string& output,
+                          options opts,
+                          uint64_t n,
+                          DocsIterator docs_begin)
+    {
+        std::string candidates[num_codecs];
+        varint_type::serialize(candidates[codec_varint], opts, n, docs_begin);
+        optpfor_type::serialize(candidates[codec_optpfor], opts, n, docs_begin);
+        pef_type::serialize(candidates[codec_pef], opts, n, docs_begin);
+        bitmap_type::serialize(candidates[codec_bitmap], opts, n, docs_begin);
+
+        // ties go to the codec that is cheaper to decode
+        uint8_t best = codec_varint;
+        for (uint8_t tag = codec_varint + 1; tag < num_codecs; ++tag)
+            if (candidates[tag].size() < candidates[best].size())
+                best = tag;
+
+        output.reserve(candidates[best].size() + 1);
+        output.assign(1, static_cast<char>(best));
+        output.append(candidates[best]);
+    }
+
+    class enumerator;
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    enumerator deserialize_at(size_t offset) const
+    {
+        return enumerator(*this, offset);
+    }
+
+#define PS_HYBRID_DISPATCH(CALL)                        \
+        switch (m_codec) {                              \
+        case codec_varint: return m_varint_enum.CALL;   \
+        case codec_optpfor: return m_optpfor_enum.CALL; \
+        case codec_pef: return m_pef_enum.CALL;         \
+        default: return m_bitmap_enum.CALL;             \
+        }
+
+    class enumerator {
+    public:
+        enumerator(const enumerator& other)
+            : m_codec(other.m_codec)
+        {
+            copy_from(other);
+        }
+
+        enumerator& operator=(const enumerator& other)
+        {
+            if (this != &other) {
+                destroy();
+                m_codec = other.m_codec;
+                copy_from(other);
+            }
+            return *this;
+        }
+
+        ~enumerator()
+        {
+            destroy();
+        }
+
+        void reset()
+        {
+            PS_HYBRID_DISPATCH(reset());
+        }
+
+        void QS_ALWAYSINLINE next()
+        {
+            PS_HYBRID_DISPATCH(next());
+        }
+
+        void QS_ALWAYSINLINE next_geq(uint64_t lower_bound)
+        {
+            PS_HYBRID_DISPATCH(next_geq(lower_bound));
+        }
+
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            PS_HYBRID_DISPATCH(extract_range(l, r, out));
+        }
+
+        void QS_ALWAYSINLINE move(uint64_t pos)
+        {
+            PS_HYBRID_DISPATCH(move(pos));
+        }
+
+        uint64_t docid() const
+        {
+            PS_HYBRID_DISPATCH(docid());
+        }
+
+        uint64_t position() const
+        {
+            PS_HYBRID_DISPATCH(position());
+        }
+
+        uint64_t size() const
+        {
+            PS_HYBRID_DISPATCH(size());
+        }
+
+        uint8_t codec() const
+        {
+            return m_codec;
+        }
+
+    private:
+        friend class hybrid_seq;
+
+        enumerator(const hybrid_seq& seq, size_t offset)
+            : m_codec(static_cast<uint8_t>(seq.m_data[offset]))
+        {
+            switch (m_codec) {
+            case codec_varint:
+                new (&m_varint_enum) varint_enum(seq.m_varint.deserialize_at(offset + 1));
+                break;
+            case codec_optpfor:
+                new (&m_optpfor_enum) optpfor_enum(seq.m_optpfor.deserialize_at(offset + 1));
+                break;
+            case codec_pef:
+                new (&m_pef_enum) pef_enum(seq.m_pef.deserialize_at(offset + 1));
+                break;
+            default:
+                new (&m_bitmap_enum) bitmap_enum(seq.m_bitmap.deserialize_at(offset + 1));
+                break;
+            }
+        }
+
+        typedef varint_type::enumerator varint_enum;
+        typedef optpfor_type::enumerator optpfor_enum;
+        typedef pef_type::enumerator pef_enum;
+        typedef bitmap_type::enumerator bitmap_enum;
+
+        void copy_from(const enumerator& other)
+        {
+            switch (m_codec) {
+            case codec_varint: new (&m_varint_enum) varint_enum(other.m_varint_enum); break;
+            case codec_optpfor: new (&m_optpfor_enum) optpfor_enum(other.m_optpfor_enum); break;
+            case codec_pef: new (&m_pef_enum) pef_enum(other.m_pef_enum); break;
+            default: new (&m_bitmap_enum) bitmap_enum(other.m_bitmap_enum); break;
+            }
+        }
+
+        void destroy()
+        {
+            switch (m_codec) {
+            case codec_varint: m_varint_enum.~varint_enum(); break;
+            case codec_optpfor: m_optpfor_enum.~optpfor_enum(); break;
+            case codec_pef: m_pef_enum.~pef_enum(); break;
+            default: m_bitmap_enum.~bitmap_enum(); break;
+            }
+        }
+
+        uint8_t m_codec;
+        union {
+            varint_enum m_varint_enum;
+            optpfor_enum m_optpfor_enum;
+            pef_enum m_pef_enum;
+            bitmap_enum m_bitmap_enum;
+        };
+    };
+
+#undef PS_HYBRID_DISPATCH
+
+private:
+    const char* m_data;
+    varint_type m_varint;
+    optpfor_type m_optpfor;
+    pef_type m_pef;
+    bitmap_type m_bitmap;
+};
+
+}
+}
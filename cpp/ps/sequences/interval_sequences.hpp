@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "block_codecs.hpp" // PEF
+#include "ps/utils.hpp"
+#include "ps/sequences/options.hpp"
+
+namespace ps {
+namespace sequences {
+
+// BV-style intervalisation: maximal runs of at least min_interval_length
+// consecutive ids are stored as (start, length) pairs, everything else as
+// gap-coded residuals.
+//
+//   n | intervals | intervals bytes | residuals | pairs | residual gaps
+//
+// The enumerator merges the two streams. Inside an interval next_geq and
+// move are plain arithmetic, and skipping a whole interval costs one pair.
+class interval_seq {
+public:
+    static const uint64_t min_interval_length = 4;
+
+    interval_seq(const char *data, uint64_t data_size, options opts)
+        : m_data(reinterpret_cast<const uint8_t *>(data))
+        , m_universe(opts.universe)
+    {}
+
+    template<typename DocsIterator>
+    static void serialize(std::string& output,
+                          options opts,
+                          uint64_t n,
+                          DocsIterator docs_begin)
+    {
+        std::vector<uint64_t> docs(n);
+        std::copy_n(docs_begin, n, docs.begin());
+
+        std::vector<uint8_t> pairs;
+        std::vector<uint8_t> gaps;
+        uint64_t intervals = 0, residuals = 0;
+        uint64_t last_end = 0, last_residual = uint64_t(-1);
+
+        for (size_t i = 0; i < n; ) {
+            size_t j = i + 1;
+            while (j < n && docs[j] == docs[j - 1] + 1)
+                ++j;
+
+            if (j - i >= min_interval_length) {
+                write_varint(pairs, intervals ? docs[i] - last_end - 1 : docs[i]);
+                write_varint(pairs, j - i - min_interval_length);
+                last_end = docs[j - 1] + 1;
+                ++intervals;
+            } else {
+                for (size_t k = i; k < j; ++k) {
+                    write_varint(gaps, docs[k] - last_residual - 1);
+                    last_residual = docs[k];
+                    ++residuals;
+                }
+            }
+
+            i = j;
+        }
+
+        std::vector<uint8_t> out;
+        write_varint(out, n);
+        write_varint(out, intervals);
+        write_varint(out, pairs.size());
+        write_varint(out, residuals);
+        out.insert(out.end(), pairs.begin(), pairs.end());
+        out.insert(out.end(), gaps.begin(), gaps.end());
+
+        output.assign(reinterpret_cast<const char*>(out.data()), out.size());
+    }
+
+    class enumerator;
+
+    const char* data() const
+    {
+        return reinterpret_cast<const char *>(m_data);
+    }
+
+    enumerator deserialize_at(size_t offset) const
+    {
+        return enumerator(m_data + offset, m_universe);
+    }
+
+    class enumerator {
+    public:
+        enumerator(uint8_t const* data, uint64_t universe)
+            : m_universe(universe)
+        {
+            uint32_t pairs_bytes;
+            data = read_varint(data, m_n);
+            data = read_varint(data, m_intervals);
+            data = read_varint(data, pairs_bytes);
+            data = read_varint(data, m_residuals);
+
+            m_pairs = data;
+            m_gaps = data + pairs_bytes;
+
+            reset();
+        }
+
+        void reset()
+        {
+            m_pair_it = m_pairs;
+            m_intervals_left = m_intervals;
+            m_int_end = 0;
+            m_int_len = 0;
+            m_int_off = 0;
+            m_int_before = 0;
+            next_interval();
+
+            m_gap_it = m_gaps;
+            m_residuals_left = m_residuals;
+            m_residual = uint64_t(-1);
+            m_res_index = 0;
+            next_residual();
+            m_res_index = 0;
+
+            update();
+        }
+
+        void PS_ALWAYSINLINE next()
+        {
+            if (m_cur_docid == m_residual) {
+                next_residual();
+            } else if (++m_int_off == m_int_len) {
+                m_int_before += m_int_len;
+                next_interval();
+            }
+
+            update();
+        }
+
+        void next_geq(uint64_t lower_bound)
+        {
+            if (lower_bound <= m_cur_docid)
+                return;
+
+            while (m_int_start != end && m_int_end <= lower_bound) {
+                m_int_before += m_int_len;
+                next_interval();
+            }
+            if (m_int_start != end && m_int_start + m_int_off < lower_bound)
+                m_int_off = lower_bound - m_int_start;
+
+            while (m_residual < lower_bound)
+                next_residual();
+
+            update();
+        }
+
+        void move(uint64_t pos)
+        {
+            if (pos < position())
+                reset();
+
+            while (position() < pos && position() < m_n) {
+                if (m_cur_docid == m_residual) {
+                    next_residual();
+                } else {
+                    // jump as far as the target, the end of the interval or
+                    // the next residual allow
+                    uint64_t step = std::min(pos - position(), m_int_len - m_int_off);
+                    step = std::min(step, m_residual - m_cur_docid);
+                    m_int_off += step;
+                    if (m_int_off == m_int_len) {
+                        m_int_before += m_int_len;
+                        next_interval();
+                    }
+                }
+
+                update();
+            }
+        }
+
+        // Appends the elements in [l, r) to out and leaves the enumerator on
+        // the first element >= r. Interval runs are written without
+        // decoding anything.
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            next_geq(l);
+
+            while (position() < m_n && m_cur_docid < r) {
+                if (m_cur_docid == m_residual) {
+                    out.push_back(m_residual);
+                    next_residual();
+                } else {
+                    uint64_t stop = std::min(std::min(m_int_end, m_residual), r);
+                    for (uint64_t docid = m_cur_docid; docid < stop; ++docid)
+                        out.push_back(docid);
+
+                    m_int_off += stop - m_cur_docid;
+                    if (m_int_off == m_int_len) {
+                        m_int_before += m_int_len;
+                        next_interval();
+                    }
+                }
+
+                update();
+            }
+        }
+
+        uint64_t docid() const
+        {
+            return m_cur_docid;
+        }
+
+        uint64_t position() const
+        {
+            return m_int_before + m_int_off + m_res_index;
+        }
+
+        uint64_t size() const
+        {
+            return m_n;
+        }
+
+    private:
+        static const uint64_t end = uint64_t(-1);
+
+        void PS_ALWAYSINLINE update()
+        {
+            uint64_t interval = (m_int_start == end) ? end : m_int_start + m_int_off;
+            m_cur_docid = std::min(interval, m_residual);
+            if (m_cur_docid == end)
+                m_cur_docid = m_universe;
+        }
+
+        void next_interval()
+        {
+            m_int_off = 0;
+
+            if (!m_intervals_left) {
+                m_int_start = end;
+                m_int_len = 0;
+                return;
+            }
+
+            uint32_t gap, len;
+            m_pair_it = read_varint(m_pair_it, gap);
+            m_pair_it = read_varint(m_pair_it, len);
+
+            m_int_start = (m_intervals_left == m_intervals) ? gap : m_int_end + gap + 1;
+            m_int_len = len + min_interval_length;
+            m_int_end = m_int_start + m_int_len;
+            --m_intervals_left;
+        }
+
+        void next_residual()
+        {
+            ++m_res_index;
+
+            if (!m_residuals_left) {
+                m_residual = end;
+                return;
+            }
+
+            uint32_t gap;
+            m_gap_it = read_varint(m_gap_it, gap);
+            m_residual += uint64_t(gap) + 1;
+            --m_residuals_left;
+        }
+
+        uint64_t m_universe;
+        uint32_t m_n;
+        uint32_t m_intervals;
+        uint32_t m_residuals;
+        uint8_t const* m_pairs;
+        uint8_t const* m_gaps;
+
+        uint8_t const* m_pair_it;
+        uint32_t m_intervals_left;
+        uint64_t m_int_start;
+        uint64_t m_int_end;
+        uint64_t m_int_len;
+        uint64_t m_int_off;
+        uint64_t m_int_before;
+
+        uint8_t const* m_gap_it;
+        uint32_t m_residuals_left;
+        uint64_t m_residual;
+        uint64_t m_res_index;
+
+        uint64_t m_cur_docid;
+    };
+
+private:
+    static void write_varint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        quasi_succinct::TightVariableByte::encode_single(value, out);
+    }
+
+    static uint8_t const* read_varint(uint8_t const* in, uint32_t& value)
+    {
+        return quasi_succinct::TightVariableByte::decode(in, &value, 1);
+    }
+
+    const uint8_t* m_data;
+    uint64_t m_universe;
+};
+
+}
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <immintrin.h>
 #include "ps/coding.hpp"
 
 namespace ps {
@@ -71,6 +72,22 @@ public:
                 next();
         }
 
+        // Appends the elements in [l, r) to out and leaves the enumerator on
+        // the first element >= r. Both ends are binary searched.
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            uint64_t begin = lower_bound(m_position, l);
+            uint64_t end = lower_bound(begin, r);
+
+            out.reserve(out.size() + (end - begin));
+            for (uint64_t i = begin; i < end; ++i)
+                out.push_back(coding::decode_fixed_64(m_data + i * 8));
+
+            m_position = end;
+            if (end < m_n)
+                m_cur_docid = coding::decode_fixed_64(m_data + end * 8);
+        }
+
         void QS_ALWAYSINLINE move(uint64_t pos)
         {
             m_position = pos;
@@ -93,6 +110,25 @@ public:
         }
 
     private:
+        // First position in [from, size()) holding a value >= value
+        uint64_t lower_bound(uint64_t from, uint64_t value) const
+        {
+            uint64_t count = m_n - from;
+            while (count > 0)
+            {
+                uint64_t step = count / 2;
+                uint64_t mid = from + step;
+                if (coding::decode_fixed_64(m_data + mid * 8) < value)
+                {
+                    from = mid + 1;
+                    count -= step + 1;
+                }
+                else
+                    count = step;
+            }
+            return from;
+        }
+
         uint32_t m_n;
         uint32_t m_position;
         char const* m_data;
@@ -104,5 +140,194 @@ private:
     char const* m_data;
 };
 
+// Same layout as plain_seq with 32-bit values. next_geq gallops from the
+// current position, narrows the window with a binary search and finishes by
+// counting the elements below the bound with SIMD compares.
+class plain32_seq {
+public:
+    plain32_seq(const char *data, uint64_t data_size, options opts)
+        : m_data(data)
+        , m_universe(opts.universe)
+    {}
+
+    template<typename DocsIterator>
+    static void serialize(std::string& output,
+                          options opts,
+                          uint64_t n,
+                          DocsIterator docs_begin)
+    {
+        output.resize((n + 1) * 4);
+        char *p = &output[0];
+
+        coding::encode_fixed_32(p, n);
+        p += 4;
+
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            coding::encode_fixed_32(p, *docs_begin++);
+            p += 4;
+        }
+    }
+
+    class enumerator;
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    enumerator deserialize_at(size_t offset) const
+    {
+        return enumerator(m_data + offset, m_universe);
+    }
+
+    class enumerator {
+    public:
+        static const uint64_t linear_window = 32;
+
+        enumerator(char const* data, uint64_t universe)
+            : m_n(coding::decode_fixed_32(data))
+            , m_position(0)
+            , m_data(reinterpret_cast<uint32_t const*>(data + 4))
+            , m_universe(universe)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            move(0);
+        }
+
+        void QS_ALWAYSINLINE next()
+        {
+            ++m_position;
+            update();
+        }
+
+        void QS_ALWAYSINLINE next_geq(uint64_t lower_bound)
+        {
+            if (m_cur_docid >= lower_bound)
+                return;
+
+            m_position = this->lower_bound(m_position + 1, lower_bound);
+            update();
+        }
+
+        void QS_ALWAYSINLINE move(uint64_t pos)
+        {
+            m_position = pos;
+            update();
+        }
+
+        // Appends the elements in [l, r) to out and leaves the enumerator on
+        // the first element >= r.
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            next_geq(l);
+
+            uint64_t end = lower_bound(m_position, r);
+            out.insert(out.end(), m_data + m_position, m_data + end);
+
+            m_position = end;
+            update();
+        }
+
+        uint64_t docid() const
+        {
+            return m_cur_docid;
+        }
+
+        uint64_t position() const
+        {
+            return m_position;
+        }
+
+        uint64_t size() const
+        {
+            return m_n;
+        }
+
+    private:
+        void QS_ALWAYSINLINE update()
+        {
+            m_cur_docid = PS_LIKELY(m_position < m_n) ? m_data[m_position] : m_universe;
+        }
+
+        // First position in [from, size()) holding a value >= value
+        uint64_t lower_bound(uint64_t from, uint64_t value) const
+        {
+            if (from >= m_n || m_data[from] >= value)
+                return from;
+            if (value > UINT32_MAX)
+                return m_n;
+
+            // m_data[lo] < value and the answer is in (lo, hi]
+            uint64_t lo = from, hi = from + 1, step = 1;
+            while (hi < m_n && m_data[hi] < value)
+            {
+                lo = hi;
+                step *= 2;
+                hi = lo + step;
+            }
+            if (hi > m_n)
+                hi = m_n;
+
+            while (hi - lo > linear_window)
+            {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (m_data[mid] < value)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+
+            return lo + 1 + count_less(m_data + lo + 1, hi - lo - 1, value);
+        }
+
+        static uint64_t count_less(uint32_t const* p, uint64_t len, uint32_t value)
+        {
+            uint64_t count = 0, i = 0;
+
+            // SSE/AVX2 only have signed compares, flipping the sign bit
+            // keeps the unsigned order
+#ifdef __AVX2__
+            const __m256i bias8 = _mm256_set1_epi32(0x80000000);
+            const __m256i bound8 = _mm256_set1_epi32(value ^ 0x80000000);
+            for (; i + 8 <= len; i += 8)
+            {
+                __m256i x = _mm256_xor_si256(_mm256_loadu_si256((__m256i const*)(p + i)), bias8);
+                __m256i lt = _mm256_cmpgt_epi32(bound8, x);
+                count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+            }
+#endif
+            const __m128i bias = _mm_set1_epi32(0x80000000);
+            const __m128i bound = _mm_set1_epi32(value ^ 0x80000000);
+            for (; i + 4 <= len; i += 4)
+            {
+                __m128i x = _mm_xor_si128(_mm_loadu_si128((__m128i const*)(p + i)), bias);
+                __m128i lt = _mm_cmplt_epi32(x, bound);
+                count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(lt)));
+            }
+
+            for (; i < len; ++i)
+                count += p[i] < value;
+
+            return count;
+        }
+
+        uint32_t m_n;
+        uint64_t m_position;
+        uint32_t const* m_data;
+        uint64_t m_universe;
+
+        uint64_t m_cur_docid;
+    };
+
+private:
+    char const* m_data;
+    uint64_t m_universe;
+};
+
 }
 }
@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+#include "block_codecs.hpp" // PEF
+#include "ps/utils.hpp"
+#include "ps/configuration.hpp"
+#include "ps/sequences/options.hpp"
+#include "ps/sequences/sequence_file.hpp"
+
+namespace ps {
+namespace sequences {
+
+// WebGraph-style reference coding. A list is written as copy blocks over one
+// of the previously appended lists plus the residual elements:
+//
+//   n | back | [blocks | blocks bytes | block lengths] | residuals | gaps
+//
+// back is the distance in bytes to the referenced list (0 when there is
+// none) and the block lengths alternate copy and skip runs over its
+// elements, starting with a copy run; whatever follows the last block is
+// skipped. Lists only refer to lists whose own chain is shorter than
+// max_chain, so a lookup never decodes more than max_chain + 1 lists.
+//
+// serialize() alone always writes a list without reference; references are
+// added by the sequence_file builder, which sees the lists in append order
+// (see sequence_appender below).
+class reference_seq {
+public:
+    static const uint64_t max_chain = 4;
+
+    reference_seq(const char *data, uint64_t data_size, options opts)
+        : m_data(reinterpret_cast<const uint8_t *>(data))
+        , m_universe(opts.universe)
+    {}
+
+    template<typename DocsIterator>
+    static void serialize(std::string& output,
+                          options opts,
+                          uint64_t n,
+                          DocsIterator docs_begin)
+    {
+        std::vector<uint64_t> docs(n);
+        std::copy_n(docs_begin, n, docs.begin());
+        encode(output, docs, nullptr, 0);
+    }
+
+    // Writes docs as copy blocks over ref (when not null) plus residuals
+    static void encode(std::string& output,
+                       const std::vector<uint64_t>& docs,
+                       const std::vector<uint64_t>* ref,
+                       uint64_t back)
+    {
+        std::vector<uint8_t> out;
+        std::vector<uint8_t> blocks;
+        std::vector<uint64_t> residuals;
+        uint64_t num_blocks = 0;
+
+        if (ref) {
+            // alternate copy and skip runs, starting with a copy run
+            bool copying = true;
+            uint64_t run = 0;
+            size_t j = 0;
+
+            for (uint64_t value : *ref) {
+                while (j < docs.size() && docs[j] < value)
+                    residuals.push_back(docs[j++]);
+
+                bool copied = (j < docs.size() && docs[j] == value);
+                if (copied)
+                    ++j;
+
+                if (copied != copying) {
+                    write_varint(blocks, run);
+                    ++num_blocks;
+                    copying = !copying;
+                    run = 0;
+                }
+                ++run;
+            }
+
+            if (copying && run) {
+                write_varint(blocks, run);
+                ++num_blocks;
+            }
+
+            residuals.insert(residuals.end(), docs.begin() + j, docs.end());
+        } else {
+            residuals = docs;
+        }
+
+        write_varint(out, docs.size());
+        write_varint(out, ref ? back : 0);
+        if (ref) {
+            write_varint(out, num_blocks);
+            write_varint(out, blocks.size());
+            out.insert(out.end(), blocks.begin(), blocks.end());
+        }
+
+        write_varint(out, residuals.size());
+        uint64_t last = uint64_t(-1);
+        for (uint64_t value : residuals) {
+            write_varint(out, value - last - 1);
+            last = value;
+        }
+
+        output.assign(reinterpret_cast<const char*>(out.data()), out.size());
+    }
+
+    class enumerator;
+
+    const char* data() const
+    {
+        return reinterpret_cast<const char *>(m_data);
+    }
+
+    enumerator deserialize_at(size_t offset) const
+    {
+        return enumerator(m_data + offset, m_universe);
+    }
+
+    class enumerator {
+    public:
+        enumerator(uint8_t const* data, uint64_t universe)
+            : m_data(data)
+            , m_universe(universe)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            init(0, m_data);
+            m_position = 0;
+        }
+
+        void next()
+        {
+            advance(0);
+            ++m_position;
+        }
+
+        void next_geq(uint64_t lower_bound)
+        {
+            while (m_position < size() && m_levels[0].cur < lower_bound)
+                next();
+        }
+
+        void move(uint64_t pos)
+        {
+            if (pos < m_position)
+                reset();
+
+            while (m_position < pos && m_position < size())
+                next();
+        }
+
+        void extract_range(uint64_t l, uint64_t r, std::vector<uint64_t>& out)
+        {
+            next_geq(l);
+
+            while (m_position < size() && m_levels[0].cur < r) {
+                out.push_back(m_levels[0].cur);
+                next();
+            }
+        }
+
+        uint64_t docid() const
+        {
+            return (m_position < size()) ? m_levels[0].cur : m_universe;
+        }
+
+        uint64_t position() const
+        {
+            return m_position;
+        }
+
+        uint64_t size() const
+        {
+            return m_levels[0].n;
+        }
+
+    private:
+        static const uint64_t end = uint64_t(-1);
+
+        // One list of the reference chain, level i + 1 is the list level i
+        // copies from
+        struct level {
+            uint32_t n;
+            bool has_ref;
+
+            uint8_t const* blocks;
+            uint32_t blocks_left;
+            uint32_t block_left;
+            bool copying;
+            uint64_t copied;
+
+            uint8_t const* residuals;
+            uint32_t residuals_left;
+            uint64_t residual;
+
+            uint64_t cur;
+        };
+
+        void init(size_t i, uint8_t const* data)
+        {
+            level& l = m_levels[i];
+            uint8_t const* p = data;
+            uint32_t back, blocks_bytes;
+
+            p = read_varint(p, l.n);
+            p = read_varint(p, back);
+            l.has_ref = (back != 0);
+
+            if (l.has_ref) {
+                assert(i < max_chain);
+                p = read_varint(p, l.blocks_left);
+                p = read_varint(p, blocks_bytes);
+                l.blocks = p;
+                p += blocks_bytes;
+
+                init(i + 1, data - back);
+            }
+
+            l.block_left = 0;
+            l.copying = false;
+            l.copied = end;
+            l.residual = uint64_t(-1);
+
+            l.residuals = read_varint(p, l.residuals_left);
+            next_residual(l);
+
+            if (l.has_ref)
+                fill_copied(i);
+
+            l.cur = std::min(l.copied, l.residual);
+        }
+
+        void advance(size_t i)
+        {
+            level& l = m_levels[i];
+
+            if (l.cur == l.residual) {
+                next_residual(l);
+            } else {
+                advance(i + 1);
+                --l.block_left;
+                fill_copied(i);
+            }
+
+            l.cur = std::min(l.copied, l.residual);
+        }
+
+        static void next_residual(level& l)
+        {
+            if (!l.residuals_left) {
+                l.residual = end;
+                return;
+            }
+
+            uint32_t gap;
+            l.residuals = read_varint(l.residuals, gap);
+            l.residual += uint64_t(gap) + 1;
+            --l.residuals_left;
+        }
+
+        // Moves the copied stream of level i to the next element of the
+        // reference that falls in a copy run
+        void fill_copied(size_t i)
+        {
+            level& l = m_levels[i];
+
+            for (;;) {
+                if (l.block_left == 0) {
+                    if (l.blocks_left == 0) {
+                        l.copied = end;
+                        return;
+                    }
+
+                    l.blocks = read_varint(l.blocks, l.block_left);
+                    --l.blocks_left;
+                    l.copying = !l.copying;
+                    continue;
+                }
+
+                if (l.copying) {
+                    l.copied = m_levels[i + 1].cur;
+                    return;
+                }
+
+                for (; l.block_left; --l.block_left)
+                    advance(i + 1);
+            }
+        }
+
+        uint8_t const* m_data;
+        uint64_t m_universe;
+        uint64_t m_position;
+        level m_levels[max_chain + 1];
+    };
+
+private:
+    static void write_varint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        quasi_succinct::TightVariableByte::encode_single(value, out);
+    }
+
+    static uint8_t const* read_varint(uint8_t const* in, uint32_t& value)
+    {
+        return quasi_succinct::TightVariableByte::decode(in, &value, 1);
+    }
+
+    const uint8_t* m_data;
+    uint64_t m_universe;
+};
+
+template <>
+struct self_contained<reference_seq> : std::false_type {};
+
+// Re-encodes every appended list, as written by serialize(), against the
+// best of the previous window lists whose chain is still shorter than the
+// configured bound
+template <>
+struct sequence_appender<reference_seq> {
+    static const bool rewrites = true;
+
+    sequence_appender()
+        : m_window(configuration::get().sequences_reference_window)
+        , m_max_chain(std::min<uint64_t>(configuration::get().sequences_reference_chain,
+                                         reference_seq::max_chain))
+    {}
+
+    const std::string& operator()(const std::string& encoded, uint64_t offset)
+    {
+        candidate current;
+        current.offset = offset;
+        current.chain = 0;
+
+        reference_seq::enumerator en(reinterpret_cast<const uint8_t*>(encoded.data()), 0);
+        current.docs.reserve(en.size());
+        for (size_t i = 0; i < en.size(); ++i, en.next())
+            current.docs.push_back(en.docid());
+
+        m_output = encoded;
+
+        for (auto& prev : m_candidates) {
+            if (prev.chain >= m_max_chain)
+                continue;
+
+            reference_seq::encode(m_buffer, current.docs, &prev.docs, offset - prev.offset);
+            if (m_buffer.size() < m_output.size()) {
+                m_output.swap(m_buffer);
+                current.chain = prev.chain + 1;
+            }
+        }
+
+        if (m_window) {
+            m_candidates.push_back(std::move(current));
+            if (m_candidates.size() > m_window)
+                m_candidates.pop_front();
+        }
+
+        return m_output;
+    }
+
+private:
+    struct candidate {
+        std::vector<uint64_t> docs;
+        uint64_t offset;
+        uint64_t chain;
+    };
+
+    uint64_t m_window;
+    uint64_t m_max_chain;
+    std::deque<candidate> m_candidates;
+    std::string m_output;
+    std::string m_buffer;
+};
+
+}
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include "ps/sequences/options.hpp"
@@ -10,6 +11,24 @@
 namespace ps {
 namespace sequences {
 
+// Called by the builder in append order with the offset each sequence is
+// going to be written at. Codecs that refer to sequences appended before
+// specialize it to rewrite the encoding; the others write it as is.
+template <typename Sequence>
+struct sequence_appender {
+    static const bool rewrites = false;
+
+    const std::string& operator()(const std::string& encoded, uint64_t offset)
+    {
+        return encoded;
+    }
+};
+
+// Whether a sequence can be decoded from its own bytes alone, without the
+// rest of the file around it
+template <typename Sequence>
+struct self_contained : std::true_type {};
+
 template <typename Sequence>
 class sequence_file
 {
@@ -78,6 +97,7 @@ public:
             coding::put_fixed_64(footer, elapsed_microsec);
 
             m_seq_file_writable->append(footer);
+            m_seq_file_writable->sync();
             m_seq_file_writable->close();
             m_seq_file.initialize();
         }
@@ -86,13 +106,59 @@ public:
         {
             uint64_t offset = m_seq_file_writable->get_file_size();
 
-            m_seq_file_writable->append(encoded_sequence);
+            m_seq_file_writable->append(m_appender(encoded_sequence, offset));
             m_num_sequences++;
             m_num_elements += num_elements;
 
             return offset;
         }
 
+        // Appends many sequences encoded back to back, sequence i ending at
+        // ends[i], with a single write, and stores where each one starts in
+        // offsets
+        void append_batch(const std::string& encoded,
+                          const std::vector<uint64_t>& ends,
+                          uint64_t num_elements,
+                          std::vector<uint64_t>& offsets)
+        {
+            uint64_t offset = m_seq_file_writable->get_file_size();
+            offsets.resize(ends.size());
+
+            if (!sequence_appender<Sequence>::rewrites) {
+                for (size_t i = 0; i < ends.size(); ++i)
+                    offsets[i] = offset + (i ? ends[i - 1] : 0);
+                if (!m_seq_file_writable->append(encoded))
+                    throw std::runtime_error("Unable to append to sequence file");
+            } else {
+                m_batch.clear();
+                for (size_t i = 0; i < ends.size(); ++i) {
+                    uint64_t begin = i ? ends[i - 1] : 0;
+                    offsets[i] = offset + m_batch.size();
+                    m_batch.append(m_appender(encoded.substr(begin, ends[i] - begin), offsets[i]));
+                }
+                if (!m_seq_file_writable->append(m_batch))
+                    throw std::runtime_error("Unable to append to sequence file");
+            }
+
+            m_num_sequences += ends.size();
+            m_num_elements += num_elements;
+        }
+
+        // Appends the contents of a committed file written with the same
+        // options, as they are, and returns the offset they start at. Offsets
+        // into other must be rebased by it.
+        uint64_t append_contents(const sequence_file& other)
+        {
+            uint64_t offset = m_seq_file_writable->get_file_size();
+
+            if (!m_seq_file_writable->append(other.data_at(0), other.contents_size()))
+                throw std::runtime_error("Unable to append to sequence file");
+            m_num_sequences += other.num_sequences();
+            m_num_elements += other.num_elements();
+
+            return offset;
+        }
+
         template<typename DocsIterator>
         uint64_t append(uint64_t n, DocsIterator docs_begin)
         {
@@ -106,6 +172,8 @@ public:
         uint64_t m_num_elements;
         boost::posix_time::ptime m_tick;
         std::unique_ptr<files::writable_file> m_seq_file_writable;
+        sequence_appender<Sequence> m_appender;
+        std::string m_batch;
     };
 
     const char* data_at(uint64_t offset) const
@@ -148,7 +216,7 @@ public:
         return m_file_size;
     }
 
-    uint64_t footer_size() const
+    static uint64_t footer_size()
     {
         return sizeof(uint8_t) * 5 + sizeof(uint64_t) * 4;
     }
@@ -158,6 +226,24 @@ public:
         return m_filename;
     }
 
+    // Decodes the footer_size() bytes written by builder::commit()
+    static void read_footer(const char* p, options& opts,
+                            uint64_t& num_sequences,
+                            uint64_t& num_elements,
+                            uint64_t& construction_time_microsec)
+    {
+        opts.params.ef_log_sampling0 = static_cast<uint8_t>(*p++);
+        opts.params.ef_log_sampling1 = static_cast<uint8_t>(*p++);
+        opts.params.rb_log_rank1_sampling = static_cast<uint8_t>(*p++);
+        opts.params.rb_log_sampling1 = static_cast<uint8_t>(*p++);
+        opts.params.log_partition_size = static_cast<uint8_t>(*p++);
+        opts.universe = coding::decode_fixed_64(p);
+
+        num_sequences = coding::decode_fixed_64(p + 8);
+        num_elements = coding::decode_fixed_64(p + 8 + 8);
+        construction_time_microsec = coding::decode_fixed_64(p + 8 + 8 + 8);
+    }
+
 private:
     void initialize()
     {
@@ -169,20 +255,12 @@ private:
         const char *data = m_mmapped_file.data();
         m_file_size = m_mmapped_file.size() / sizeof(data[0]);
 
+        files::apply_mapping_policy(m_filename, data, m_file_size,
+                                    files::mapping_policy::for_file(m_filename));
+
         // We read the footer first
-        const char *p = data;
-        p += m_file_size - footer_size();
-
-        m_opts.params.ef_log_sampling0 = static_cast<uint8_t>(*p++);
-        m_opts.params.ef_log_sampling1 = static_cast<uint8_t>(*p++);
-        m_opts.params.rb_log_rank1_sampling = static_cast<uint8_t>(*p++);
-        m_opts.params.rb_log_sampling1 = static_cast<uint8_t>(*p++);
-        m_opts.params.log_partition_size = static_cast<uint8_t>(*p++);
-        m_opts.universe = coding::decode_fixed_64(p);
-
-        m_num_sequences = coding::decode_fixed_64(p + 8);
-        m_num_elements = coding::decode_fixed_64(p + 8 + 8);
-        m_construction_time_microsec = coding::decode_fixed_64(p + 8 + 8 + 8);
+        read_footer(data + m_file_size - footer_size(), m_opts, m_num_sequences,
+                    m_num_elements, m_construction_time_microsec);
 
         // std::cout << "sequence_file is"
         //     << " params.ef_log_sampling0=" << (int)m_opts.params.ef_log_sampling0
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <string>
+#include <vector>
 #include "block_codecs.hpp"
+#include "ps/sequences/ef_sequences.hpp"
 
 namespace ps {
 namespace sequences {
@@ -40,7 +43,7 @@ private:
     std::string m_encoded;
 };
 
-bool unpack_sequence(int idx, const char* data, uint32_t& displacement)
+inline bool unpack_sequence(int idx, const char* data, uint32_t& displacement)
 {
     const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
 
@@ -59,5 +62,133 @@ bool unpack_sequence(int idx, const char* data, uint32_t& displacement)
     }
 }
 
+// Same as sequence_packer, but the start offsets of the sequences are kept
+// in an Elias-Fano directory in front of them, so that the i-th sequence is
+// found with one sampled select instead of a walk over the previous ones:
+//
+//   count | payload bytes | ef(offsets, count + 1 values) | payloads
+//
+// Empty sequences take no payload bytes.
+class indexed_sequence_packer {
+public:
+    template <typename Sequence, typename DocsIterator>
+    void append(options opts,
+                uint64_t n,
+                DocsIterator docs_begin)
+    {
+        if (n > 0)
+            Sequence::serialize(m_output, opts, n, docs_begin);
+        else
+            m_output.clear();
+
+        append_raw(m_output);
+    }
+
+    void append_raw(const std::string& output)
+    {
+        m_offsets.push_back(m_payloads.size());
+        m_payloads.append(output);
+    }
+
+    uint64_t size() const
+    {
+        return m_offsets.size();
+    }
+
+    void encode(std::string& output) const
+    {
+        std::vector<uint64_t> offsets(m_offsets);
+        offsets.push_back(m_payloads.size());
+
+        std::vector<uint8_t> out;
+        quasi_succinct::TightVariableByte::encode_single(m_offsets.size(), out);
+        quasi_succinct::TightVariableByte::encode_single(m_payloads.size(), out);
+        ef::write(out, offsets.begin(), offsets.size(), 0, m_payloads.size() + 1, true);
+
+        output.reserve(out.size() + m_payloads.size());
+        output.assign(reinterpret_cast<const char*>(out.data()), out.size());
+        output.append(m_payloads);
+    }
+
+private:
+    std::vector<uint64_t> m_offsets;
+    std::string m_payloads;
+    std::string m_output;
+};
+
+// Read side of indexed_sequence_packer. The enumerators point straight into
+// the packed buffer, nothing is copied.
+template <typename Sequence>
+class packed_sequences {
+public:
+    typedef typename Sequence::enumerator enumerator;
+
+    packed_sequences(const char* data, options opts)
+        : m_count(0)
+        , m_payload_bytes(0)
+        , m_directory(read_header(reinterpret_cast<const uint8_t*>(data)))
+        , m_payloads(reinterpret_cast<const char*>(m_directory)
+                     + ef::layout(m_count + 1, m_payload_bytes + 1, true).bytes)
+        , m_seq(m_payloads, m_payload_bytes, opts)
+    {}
+
+    uint64_t size() const
+    {
+        return m_count;
+    }
+
+    // Offset of the i-th sequence in the payloads and its length in bytes,
+    // 0 for an empty sequence
+    void locate(uint64_t i, uint64_t& offset, uint64_t& bytes) const
+    {
+        ef::cursor c(m_directory, m_count + 1, m_payload_bytes + 1, true);
+        c.move(i);
+        offset = c.value();
+        c.next();
+        bytes = c.value() - offset;
+    }
+
+    bool empty(uint64_t i) const
+    {
+        uint64_t offset, bytes;
+        locate(i, offset, bytes);
+        return bytes == 0;
+    }
+
+    // Must not be called on an empty sequence
+    enumerator at(uint64_t i) const
+    {
+        uint64_t offset, bytes;
+        locate(i, offset, bytes);
+        assert(bytes);
+        return m_seq.deserialize_at(offset);
+    }
+
+    // Total size of the packed buffer
+    uint64_t bytes() const
+    {
+        return (m_payloads - m_data) + m_payload_bytes;
+    }
+
+private:
+    uint8_t const* read_header(uint8_t const* data)
+    {
+        m_data = reinterpret_cast<const char*>(data);
+        uint32_t count, payload_bytes;
+        data = quasi_succinct::TightVariableByte::decode(data, &count, 1);
+        data = quasi_succinct::TightVariableByte::decode(data, &payload_bytes, 1);
+        m_count = count;
+        m_payload_bytes = payload_bytes;
+        return data;
+    }
+
+    const char* m_data;
+    uint64_t m_count;
+    uint64_t m_payload_bytes;
+    uint8_t const* m_directory;
+    const char* m_payloads;
+    Sequence m_seq;
+};
+
+}
 }
-}
\ No newline at end of file
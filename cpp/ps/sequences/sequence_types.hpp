@@ -5,8 +5,14 @@
 #include <boost/preprocessor/cat.hpp>
 
 #include "ps/sequences/block_sequences.hpp"
+#include "ps/sequences/streamvbyte_block.hpp"
 #include "ps/sequences/elias_sequences.hpp"
+#include "ps/sequences/ef_sequences.hpp"
 #include "ps/sequences/plain_sequences.hpp"
+#include "ps/sequences/bitmap_sequences.hpp"
+#include "ps/sequences/hybrid_sequences.hpp"
+#include "ps/sequences/reference_sequences.hpp"
+#include "ps/sequences/interval_sequences.hpp"
 
 #include "compact_elias_fano.hpp"
 #include "partitioned_sequence.hpp"
@@ -24,10 +30,12 @@ typedef elias_seq<quasi_succinct::partitioned_sequence<>> opt_seq;
 typedef block_seq<quasi_succinct::optpfor_block> block_optpfor_seq;
 typedef block_seq<quasi_succinct::varint_G8IU_block> block_varint_seq;
 typedef block_seq<quasi_succinct::interpolative_block> block_interpolative_seq;
+typedef block_seq<streamvbyte_block> block_streamvbyte_seq;
 
 typedef plain_seq fixed_seq;
+typedef plain32_seq fixed32_seq;
 
 }
 }
 
-#define PS_SEQ_TYPES (ef)(single)(uniform)(opt)(block_optpfor)(block_varint)(block_interpolative)(fixed)
\ No newline at end of file
+#define PS_SEQ_TYPES (ef)(single)(uniform)(opt)(native_ef)(native_pef)(block_optpfor)(block_varint)(block_interpolative)(block_streamvbyte)(fixed)(fixed32)(bitmap)(hybrid)(reference)(interval)
\ No newline at end of file
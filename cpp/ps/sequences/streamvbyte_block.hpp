@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <tmmintrin.h>
+#include "ps/utils.hpp"
+
+namespace ps {
+namespace sequences {
+
+// Stream VByte block codec for block_seq. The 2-bit byte lengths of four
+// values are packed in a control byte and all control bytes come before the
+// data bytes, so a group of four values is decoded with one pshufb driven by
+// a table indexed by its control byte.
+struct streamvbyte_block {
+    static const uint64_t block_size = 128;
+
+    static void encode(uint32_t const* in,
+                       uint32_t sum_of_values,
+                       size_t n,
+                       std::vector<uint8_t>& out)
+    {
+        size_t control_begin = out.size();
+        out.resize(control_begin + (n + 3) / 4, 0);
+
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t v = in[i];
+            uint8_t len = (v < (1U << 8)) ? 1 : (v < (1U << 16)) ? 2 : (v < (1U << 24)) ? 3 : 4;
+            out[control_begin + i / 4] |= (len - 1) << (2 * (i % 4));
+
+            for (uint8_t b = 0; b < len; ++b)
+                out.push_back((v >> (8 * b)) & 0xff);
+        }
+    }
+
+    static uint8_t const* decode(uint8_t const* in,
+                                 uint32_t* out,
+                                 uint32_t sum_of_values,
+                                 size_t n)
+    {
+        const tables& t = get_tables();
+        uint8_t const* control = in;
+        uint8_t const* data = in + (n + 3) / 4;
+        size_t groups = n / 4;
+
+        uint8_t const* data_end = data;
+        for (size_t g = 0; g < (n + 3) / 4; ++g)
+            data_end += t.length[control[g]];
+        if (n % 4) // the unused lanes of the last control byte are zero
+            data_end -= 4 - n % 4;
+
+        // pshufb loads 16 bytes, the tail that could read past the block
+        // falls back to the scalar loop
+        size_t g = 0;
+        for (; g < groups && data + 16 <= data_end; ++g) {
+            __m128i in_bytes = _mm_loadu_si128((__m128i const*)data);
+            __m128i mask = _mm_loadu_si128((__m128i const*)t.shuffle[control[g]]);
+            _mm_storeu_si128((__m128i*)(out + 4 * g), _mm_shuffle_epi8(in_bytes, mask));
+            data += t.length[control[g]];
+        }
+
+        for (size_t i = 4 * g; i < n; ++i) {
+            uint8_t len = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+            uint32_t v = 0;
+            for (uint8_t b = 0; b < len; ++b)
+                v |= uint32_t(data[b]) << (8 * b);
+            out[i] = v;
+            data += len;
+        }
+
+        return data;
+    }
+
+private:
+    struct tables {
+        tables()
+        {
+            for (unsigned c = 0; c < 256; ++c) {
+                uint8_t pos = 0;
+                for (unsigned i = 0; i < 4; ++i) {
+                    uint8_t len = ((c >> (2 * i)) & 3) + 1;
+                    for (unsigned b = 0; b < 4; ++b)
+                        shuffle[c][4 * i + b] = (b < len) ? pos + b : 0x80;
+                    pos += len;
+                }
+                length[c] = pos;
+            }
+        }
+
+        alignas(16) uint8_t shuffle[256][16];
+        uint8_t length[256];
+    };
+
+    static const tables& get_tables()
+    {
+        static const tables t;
+        return t;
+    }
+};
+
+}
+}
@@ -0,0 +1,166 @@
+#include "ps/optargs.hpp"
+#include "ps/protocol.hpp"
+#include "ps/problems/schemes.hpp"
+#include "ps/utils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace ps;
+
+typedef std::chrono::steady_clock clock_type;
+
+struct connection_stats {
+    connection_stats()
+        : errors(0)
+        , results(0)
+    {}
+
+    std::vector<uint64_t> latencies_nsec;
+    uint64_t errors;
+    uint64_t results;
+};
+
+// Keeps up to depth requests in flight on one connection: a thread sends,
+// the calling one receives
+void run_connection(const std::string& address,
+                    const std::vector<protocol::request>& requests,
+                    size_t depth,
+                    connection_stats& stats)
+{
+    protocol::client client(address);
+    std::vector<clock_type::time_point> sent(requests.size());
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t in_flight = 0;
+
+    std::thread sender([&]() {
+        for (size_t i = 0; i < requests.size(); ++i) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (in_flight >= depth)
+                    cond.wait(lock);
+                in_flight++;
+                sent[i] = clock_type::now();
+            }
+            client.send(requests[i]);
+        }
+    });
+
+    protocol::response res;
+    stats.latencies_nsec.reserve(requests.size());
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        client.receive(res);
+        clock_type::time_point now = clock_type::now();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.latencies_nsec.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent[res.id]).count());
+        if (res.status != protocol::ok)
+            stats.errors++;
+        stats.results += res.docids.size();
+        in_flight--;
+        cond.notify_one();
+    }
+
+    sender.join();
+}
+
+int main(int argc, char *argv[])
+{
+    PARSE_ARGUMENTS(
+        ("help", "produce help message")
+        ("connect,c", po::value<std::string>()->default_value("/tmp/ps.sock"), "Unix socket path or tcp:<port> on loopback")
+        ("attribute,a", po::value<int>()->default_value(0), "Attribute to query")
+        ("scheme,s", po::value<std::string>()->default_value("hopping"), "Scheme to solve the problem")
+        ("topk,k", po::value<int>()->default_value(0), "Top k retrieval")
+        ("requests,n", po::value<size_t>()->default_value(100000), "Requests per connection")
+        ("connections", po::value<size_t>()->default_value(1), "Concurrent connections")
+        ("depth", po::value<size_t>()->default_value(16), "Requests in flight per connection")
+    )
+
+    problems::Scheme scheme;
+    if (!problems::scheme_from_name(vm["scheme"].as<std::string>(), scheme)) {
+        std::cerr << "ERROR: Unknown scheme " << vm["scheme"].as<std::string>() << std::endl;
+        return -1;
+    }
+
+    // queries are read from stdin, one "user<TAB>prefix" per line
+    std::vector<std::pair<uint64_t, std::string>> queries;
+    for (std::string line; std::getline(std::cin, line); ) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+            continue;
+        queries.emplace_back(std::stoull(line.substr(0, tab)), line.substr(tab + 1));
+    }
+
+    if (queries.empty()) {
+        std::cerr << "ERROR: No queries on stdin" << std::endl;
+        return -1;
+    }
+
+    size_t num_connections = std::max<size_t>(vm["connections"].as<size_t>(), 1);
+    size_t num_requests = vm["requests"].as<size_t>();
+    std::vector<std::vector<protocol::request>> requests(num_connections);
+
+    for (size_t c = 0; c < num_connections; ++c) {
+        requests[c].resize(num_requests);
+        for (size_t i = 0; i < num_requests; ++i) {
+            auto const& q = queries[(c * num_requests + i) % queries.size()];
+            protocol::request& req = requests[c][i];
+            req.id = i;
+            req.attribute = vm["attribute"].as<int>();
+            req.scheme = scheme;
+            req.k = vm["topk"].as<int>();
+            req.user = q.first;
+            req.prefix = q.second;
+        }
+    }
+
+    std::vector<connection_stats> stats(num_connections);
+    std::vector<std::thread> threads;
+    clock_type::time_point start = clock_type::now();
+
+    for (size_t c = 0; c < num_connections; ++c)
+        threads.emplace_back(run_connection, vm["connect"].as<std::string>(),
+                             std::cref(requests[c]), vm["depth"].as<size_t>(),
+                             std::ref(stats[c]));
+    for (auto& t : threads)
+        t.join();
+
+    double elapsed_sec = std::chrono::duration_cast<std::chrono::microseconds>(
+        clock_type::now() - start).count() / 1e6;
+
+    std::vector<uint64_t> latencies;
+    uint64_t errors = 0, results = 0;
+    for (auto const& s : stats) {
+        latencies.insert(latencies.end(), s.latencies_nsec.begin(), s.latencies_nsec.end());
+        errors += s.errors;
+        results += s.results;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&](double p) {
+        return latencies[std::min<size_t>(latencies.size() - 1, p * latencies.size())] / 1000.0;
+    };
+
+    std::cout << "requests=" << latencies.size()
+              << " errors=" << errors
+              << " avg-results=" << (double)results / latencies.size()
+              << " qps=" << latencies.size() / elapsed_sec
+              << std::endl
+              << "latency-usec"
+              << " p50=" << percentile(0.5)
+              << " p90=" << percentile(0.9)
+              << " p99=" << percentile(0.99)
+              << " p99.9=" << percentile(0.999)
+              << " max=" << latencies.back() / 1000.0
+              << std::endl;
+
+    return errors ? 1 : 0;
+}
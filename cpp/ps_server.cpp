@@ -0,0 +1,232 @@
+#include "ps/optargs.hpp"
+#include "ps/engine.hpp"
+#include "ps/protocol.hpp"
+#include <signal.h>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+using namespace ps;
+
+// Responses are written by the engine workers, possibly several at a time
+// for the same client
+struct connection : boost::noncopyable {
+    static const size_t max_in_flight = 4096;
+
+    connection(int fd)
+        : fd(fd)
+        , in_flight(0)
+        , broken(false)
+    {}
+
+    ~connection()
+    {
+        ::close(fd);
+    }
+
+    void respond(uint64_t id, const engine::result& res)
+    {
+        char header[4 + protocol::response_header_size];
+        struct iovec iov[2];
+
+        if (res.error.empty()) {
+            size_t bytes = res.docids.size() * sizeof(uint64_t);
+            protocol::encode_response_header(header, id, protocol::ok, res.l, res.r,
+                                             res.docids.size(), bytes);
+            iov[1].iov_base = const_cast<uint64_t*>(res.docids.data());
+            iov[1].iov_len = bytes;
+        } else {
+            protocol::encode_response_header(header, id, protocol::error, res.l, res.r,
+                                             0, res.error.size());
+            iov[1].iov_base = const_cast<char*>(res.error.data());
+            iov[1].iov_len = res.error.size();
+        }
+        iov[0].iov_base = header;
+        iov[0].iov_len = sizeof(header);
+
+        {
+            std::lock_guard<std::mutex> lock(write_mutex);
+            if (!broken && !protocol::write_full(fd, iov, 2))
+                broken = true;
+        }
+
+        std::lock_guard<std::mutex> lock(flight_mutex);
+        in_flight--;
+        flight_cond.notify_one();
+    }
+
+    void respond_error(uint64_t id, const std::string& error)
+    {
+        engine::result res;
+        res.l = res.r = -1;
+        res.error = error;
+        respond(id, res);
+    }
+
+    // Stops reading from a client that does not read its responses
+    void wait_room(size_t requests)
+    {
+        std::unique_lock<std::mutex> lock(flight_mutex);
+        while (in_flight && in_flight + requests > max_in_flight)
+            flight_cond.wait(lock);
+        in_flight += requests;
+    }
+
+    int fd;
+    std::mutex write_mutex;
+    std::mutex flight_mutex;
+    std::condition_variable flight_cond;
+    size_t in_flight;
+    bool broken;
+};
+
+struct batch {
+    std::vector<engine::query> queries;
+    std::vector<uint64_t> ids;
+};
+
+// Reads as many requests as the socket has ready and submits them to the
+// engines of their attributes as one batch each
+void serve(std::shared_ptr<connection> conn, const std::vector<std::unique_ptr<engine>>& engines)
+{
+    std::vector<char> buffer(1 << 16);
+    size_t filled = 0;
+    protocol::request req;
+
+    for (;;) {
+        ssize_t got = ::read(conn->fd, buffer.data() + filled, buffer.size() - filled);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        filled += got;
+
+        std::vector<std::shared_ptr<batch>> batches(engines.size());
+        std::vector<std::pair<uint64_t, std::string>> errors;
+        size_t pos = 0;
+        bool malformed = false;
+
+        while (filled - pos >= 4) {
+            uint32_t length = coding::decode_fixed_32(buffer.data() + pos);
+            if (length > protocol::max_frame_size) {
+                malformed = true;
+                break;
+            }
+            if (filled - pos - 4 < length) {
+                if (4 + length > buffer.size())
+                    buffer.resize(4 + length);
+                break;
+            }
+            if (!protocol::decode_request(buffer.data() + pos + 4, length, req)) {
+                malformed = true;
+                break;
+            }
+            pos += 4 + length;
+
+            if (req.attribute >= engines.size()) {
+                errors.emplace_back(req.id, "Unknown attribute");
+                continue;
+            }
+
+            std::shared_ptr<batch>& b = batches[req.attribute];
+            if (!b)
+                b.reset(new batch());
+            b->queries.emplace_back(req.user, req.prefix, problems::Scheme(req.scheme), req.k);
+            b->ids.push_back(req.id);
+        }
+
+        memmove(buffer.data(), buffer.data() + pos, filled - pos);
+        filled -= pos;
+
+        size_t requests = errors.size();
+        for (auto const& b : batches)
+            requests += b ? b->queries.size() : 0;
+        conn->wait_room(requests);
+
+        for (auto const& e : errors)
+            conn->respond_error(e.first, e.second);
+
+        for (size_t a = 0; a < batches.size(); ++a) {
+            std::shared_ptr<batch> b = batches[a];
+            if (!b)
+                continue;
+
+            std::shared_ptr<const std::vector<engine::query>> queries(b, &b->queries);
+            engines[a]->submit(queries, [b, conn](size_t i, const engine::query&, const engine::result& res) {
+                conn->respond(b->ids[i], res);
+            });
+        }
+
+        if (malformed) {
+            logger() << "Malformed request, closing connection" << std::endl;
+            break;
+        }
+    }
+
+    // the pending callbacks hold the connection, the last one closes it
+    ::shutdown(conn->fd, SHUT_RD);
+}
+
+engine::config parse_attribute(const std::string& spec)
+{
+    engine::config cfg;
+    std::vector<std::string> fields;
+    boost::algorithm::split(fields, spec, boost::algorithm::is_any_of(","));
+
+    for (auto const& field : fields) {
+        size_t eq = field.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("Malformed attribute field " + field);
+
+        std::string key = field.substr(0, eq);
+        std::string value = field.substr(eq + 1);
+
+        if (key == "index-type") cfg.index_type = value;
+        else if (key == "index") cfg.index = value;
+        else if (key == "dict-type") cfg.dict_type = value;
+        else if (key == "dictionary") cfg.dictionary = value;
+        else if (key == "id-mapping") cfg.id_mapping = value;
+        else if (key == "dict-remapping") cfg.dict_remapping = value;
+        else if (key == "ranking") cfg.ranking = value;
+        else if (key == "wand") cfg.wand = value;
+        else if (key == "plan") cfg.plan = (value == "1" || value == "true");
+        else throw std::runtime_error("Unknown attribute field " + key);
+    }
+
+    return cfg;
+}
+
+int main(int argc, char *argv[])
+{
+    PARSE_ARGUMENTS(
+        ("help", "produce help message")
+        ("listen,l", po::value<std::string>()->default_value("/tmp/ps.sock"), "Unix socket path or tcp:<port> on loopback")
+        ("attribute,a", po::value<std::vector<std::string>>()->required()->composing(),
+         "Index served as attribute 0, 1, ...: index-type=T,index=F,dict-type=T,dictionary=F"
+         "[,id-mapping=F][,dict-remapping=F][,ranking=F][,wand=F][,plan=1]")
+    )
+
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::unique_ptr<engine>> engines;
+    for (auto const& spec : vm["attribute"].as<std::vector<std::string>>()) {
+        logger() << "Loading attribute " << engines.size() << ": " << spec << std::endl;
+        engines.push_back(engine::open(parse_attribute(spec)));
+    }
+
+    std::string address = vm["listen"].as<std::string>();
+    int listen_fd = protocol::open_socket(address, true);
+    logger() << "Listening on " << address << std::endl;
+
+    for (;;) {
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            logger() << "accept failed: " << strerror(errno) << std::endl;
+            return -1;
+        }
+
+        std::shared_ptr<connection> conn(new connection(fd));
+        std::thread(serve, conn, std::cref(engines)).detach();
+    }
+}
@@ -7,6 +7,7 @@
 #include "ps/problems/schemes.hpp"
 #include "ps/problems/intersection.hpp"
 #include "ps/problems/topk.hpp"
+#include "ps/problems/planner.hpp"
 #include <boost/chrono.hpp>
 #include <fstream>
 #include <random>
@@ -31,6 +32,29 @@ void execute_prefix_search(const DictType& dictionary,
     r = pair.second;
 }
 
+// Lets the planner pick the scheme of the query if plan is set, and prints
+// its estimates if explain is set
+template<typename Index>
+void plan_query(const planner<Index>& query_planner,
+                int sort_id,
+                int l,
+                int r,
+                int topk,
+                bool plan,
+                bool explain,
+                Scheme& scheme,
+                uint64_t& tt_plan_usec)
+{
+    bc::high_resolution_clock::time_point t_start = bc::high_resolution_clock::now();
+    problems::plan p = query_planner.make_plan(scheme, sort_id, l, r, topk);
+    tt_plan_usec = bc::duration_cast<bc::nanoseconds>(bc::high_resolution_clock::now() - t_start).count();
+
+    if (explain)
+        p.explain(std::cerr);
+    if (plan)
+        scheme = p.chosen;
+}
+
 template<typename Index, typename DictType>
 void process_intersection(const Index& index,
                           const DictType& dictionary,
@@ -39,9 +63,12 @@ void process_intersection(const Index& index,
                           int user_id,
                           int sort_id,
                           const std::string& query,
-                          const Scheme scheme,
+                          Scheme scheme,
                           const vector<uint64_t>& ground_truth,
-                          bool verification)
+                          bool verification,
+                          const planner<Index>* query_planner,
+                          bool plan,
+                          bool explain)
 {
     std::vector<uint64_t> result;
     uint64_t tt_psearch_usec = 0;
@@ -54,6 +81,10 @@ void process_intersection(const Index& index,
     execute_prefix_search<DictType>(dictionary, query, l, r);
     tt_psearch_usec = bc::duration_cast<bc::nanoseconds>(bc::high_resolution_clock::now() - t_start).count();
 
+    uint64_t tt_plan_usec = 0;
+    if (l != -1 && query_planner)
+        plan_query(*query_planner, sort_id, l, r, 0, plan, explain, scheme, tt_plan_usec);
+
     if (l != -1)
     {
         switch (scheme)
@@ -147,6 +178,8 @@ void process_intersection(const Index& index,
         exit(-1);
     }
 
+    tt_inter_usec += tt_plan_usec;
+
     std::cout << iteration      << "\t"
               << user_id        << "\t"
               << query          << "\t"
@@ -167,10 +200,13 @@ void process_topk(const Index& index,
                   int user_id,
                   int sort_id,
                   const std::string& query,
-                  const Scheme scheme,
+                  Scheme scheme,
                   const vector<uint64_t>& ground_truth,
                   bool verification,
-                  const int topk)
+                  const int topk,
+                  const planner<Index>* query_planner,
+                  bool plan,
+                  bool explain)
 {
     std::vector<uint64_t> result(topk);
     uint64_t tt_psearch_usec = 0;
@@ -183,6 +219,10 @@ void process_topk(const Index& index,
     execute_prefix_search<DictType>(dictionary, query, l, r);
     tt_psearch_usec = bc::duration_cast<bc::nanoseconds>(bc::high_resolution_clock::now() - t_start).count();
 
+    uint64_t tt_plan_usec = 0;
+    if (l != -1 && query_planner)
+        plan_query(*query_planner, sort_id, l, r, topk, plan, explain, scheme, tt_plan_usec);
+
     if (l != -1)
     {
         switch (scheme)
@@ -242,6 +282,8 @@ void process_topk(const Index& index,
         exit(-1);
     }
 
+    tt_inter_usec += tt_plan_usec;
+
     std::cout << iteration      << "\t"
               << user_id        << "\t"
               << query          << "\t"
@@ -334,7 +376,9 @@ int prefix_search(const std::string& query_file,
                   const int iterations,
                   const int topk,
                   const bool verification,
-                  const int seed)
+                  const int seed,
+                  const bool plan,
+                  const bool explain)
 {
     Scheme s = Scheme::AsIndex;
 
@@ -422,6 +466,10 @@ int prefix_search(const std::string& query_file,
         }
     }
 
+    std::unique_ptr<planner<Index>> query_planner;
+    if (plan || explain)
+        query_planner.reset(new planner<Index>(index, !vec_remapping.empty(), !wand_data.empty()));
+
     std::vector<query_type> queries;
     read_queries(uid_to_sid, ranking, topk, query_file, queries, verification);
 
@@ -434,12 +482,14 @@ int prefix_search(const std::string& query_file,
             if (topk == 0)
                 process_intersection<Index, DictType>(
                     index, dictionary, vec_remapping, i,
-                    std::get<0>(q), std::get<1>(q), std::get<2>(q), s, std::get<3>(q), verification
+                    std::get<0>(q), std::get<1>(q), std::get<2>(q), s, std::get<3>(q), verification,
+                    query_planner.get(), plan, explain
                 );
             else
                 process_topk<Index, DictType>(
                     index, dictionary, vec_remapping, ranking, wand, i,
-                    std::get<0>(q), std::get<1>(q), std::get<2>(q), s, std::get<3>(q), verification, topk
+                    std::get<0>(q), std::get<1>(q), std::get<2>(q), s, std::get<3>(q), verification, topk,
+                    query_planner.get(), plan, explain
                 );
         }
     }
@@ -460,7 +510,9 @@ int prefix_search(const std::string query_file,
                   const int iterations,
                   const int topk,
                   const bool verification,
-                  const int seed)
+                  const int seed,
+                  const bool plan,
+                  const bool explain)
 {
     if (false) {
 #define LOOP_BODY(R, DATA, T)                                \
@@ -478,7 +530,9 @@ int prefix_search(const std::string query_file,
             iterations,                                      \
             topk,                                            \
             verification,                                    \
-            seed                                             \
+            seed,                                            \
+            plan,                                            \
+            explain                                          \
         );
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_DICT_TYPES);
@@ -502,7 +556,9 @@ int prefix_search(const std::string& query_file,
                   const int iterations,
                   const int topk,
                   const bool verification,
-                  const int seed)
+                  const int seed,
+                  const bool plan,
+                  const bool explain)
 {
     if (false) {
 #define LOOP_BODY(R, DATA, T)                               \
@@ -521,7 +577,9 @@ int prefix_search(const std::string& query_file,
             iterations,                                     \
             topk,                                           \
             verification,                                   \
-            seed                                            \
+            seed,                                           \
+            plan,                                           \
+            explain                                         \
         );
 
         BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_INDEX_TYPES);
@@ -550,6 +608,8 @@ int main(int argc, char *argv[])
         ("wand", po::value<std::string>()->default_value(""), "WAND auxiliary data")
         ("verification,v", po::value<bool>()->default_value(true), "Verify results")
         ("seed", po::value<int>()->default_value(42), "Seed number")
+        ("plan", "Let the planner pick the scheme of each query among the ones solving the same problem as --scheme")
+        ("explain", "Print the estimates of the planner for each query on stderr")
     )
 
     return prefix_search(
@@ -566,6 +626,8 @@ int main(int argc, char *argv[])
         vm["iterations"].as<int>(),
         vm["topk"].as<int>(),
         vm["verification"].as<bool>(),
-        vm["seed"].as<int>()
+        vm["seed"].as<int>(),
+        vm.count("plan") > 0,
+        vm.count("explain") > 0
     );
 }
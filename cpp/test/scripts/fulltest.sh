@@ -2,7 +2,7 @@
 
 MYTMPDIR=$(mktemp -d 2>/dev/null || mktemp -d -t 'mytmpdir')
 ENCODINGS=(
-    "block_varint_simple" "block_optpfor_simple" "block_interpolative_simple" "ef_simple" "single_simple" "uniform_simple" "opt_simple" "fixed_simple"
+    "block_varint_simple" "block_optpfor_simple" "block_interpolative_simple" "block_streamvbyte_simple" "ef_simple" "single_simple" "uniform_simple" "opt_simple" "native_ef_simple" "native_pef_simple" "fixed_simple" "fixed32_simple" "bitmap_simple" "hybrid_simple" "reference_simple" "interval_simple"
 )
 ENCODING=${ENCODINGS[$RANDOM % ${#ENCODINGS[@]} ]}
 
@@ -11,11 +11,19 @@ SEQUENCES = (
     "block_varint",
     "block_optpfor",
     "block_interpolative",
+    "block_streamvbyte",
     "ef",
     "single",
     "uniform",
     "opt",
-    "fixed"
+    "native_ef",
+    "native_pef",
+    "fixed",
+    "fixed32",
+    "bitmap",
+    "hybrid",
+    "reference",
+    "interval"
 )
 
 DUMMY_INDEX = "fixed_simple"
@@ -24,33 +32,57 @@ SIMPLE_INDICES = (
     "block_varint_simple",
     "block_optpfor_simple",
     "block_interpolative_simple",
+    "block_streamvbyte_simple",
     "ef_simple",
     "single_simple",
     "uniform_simple",
     "opt_simple",
+    "native_ef_simple",
+    "native_pef_simple",
     "fixed_simple",
+    "fixed32_simple",
+    "bitmap_simple",
+    "hybrid_simple",
+    "reference_simple",
+    "interval_simple",
 )
 
 COVERAGE_INDICES = (
     "block_varint_coverage",
     "block_optpfor_coverage",
     "block_interpolative_coverage",
+    "block_streamvbyte_coverage",
     "ef_coverage",
     "single_coverage",
     "uniform_coverage",
     "opt_coverage",
+    "native_ef_coverage",
+    "native_pef_coverage",
     "fixed_coverage",
+    "fixed32_coverage",
+    "bitmap_coverage",
+    "hybrid_coverage",
+    "reference_coverage",
+    "interval_coverage",
 )
 
 TOPK_INDICES = (
     "block_varint_topk",
     "block_optpfor_topk",
     "block_interpolative_topk",
+    "block_streamvbyte_topk",
     "ef_topk",
     "single_topk",
     "uniform_topk",
     "opt_topk",
+    "native_ef_topk",
+    "native_pef_topk",
     "fixed_topk",
+    "fixed32_topk",
+    "bitmap_topk",
+    "hybrid_topk",
+    "reference_topk",
+    "interval_topk",
 )
 
 
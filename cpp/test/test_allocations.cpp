@@ -0,0 +1,194 @@
+#define BOOST_TEST_MODULE allocations
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "test/test_generic_sequence.hpp"
+
+#include "ps/sequences/sequence_types.hpp"
+#include "ps/indices/index_types.hpp"
+#include "ps/indices/neighbors.hpp"
+#include "ps/problems/intersection.hpp"
+
+using namespace ps;
+using namespace ps::sequences;
+using namespace ps::indices;
+using namespace ps::problems;
+namespace bfs = boost::filesystem;
+
+// Every operator new issued while counting is enabled is recorded here
+static bool g_counting = false;
+static size_t g_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    if (g_counting)
+        g_allocations++;
+
+    void* p = std::malloc(size ? size : 1);
+
+    if (!p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+struct allocation_counter {
+    allocation_counter()
+    {
+        g_allocations = 0;
+        g_counting = true;
+    }
+
+    ~allocation_counter()
+    {
+        g_counting = false;
+    }
+
+    size_t count() const
+    {
+        return g_allocations;
+    }
+};
+
+template <typename Sequence>
+void test_enumerator_allocations(const char *name)
+{
+    uint64_t universe = 100000;
+    options opts(universe);
+
+    std::string encoded;
+    std::vector<uint64_t> offsets;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        std::vector<uint64_t> current = random_sequence(universe, 1 + rand() % 1000);
+        std::string output;
+        Sequence::serialize(output, opts, current.size(), current.begin());
+
+        offsets.push_back(encoded.size());
+        encoded.append(output);
+    }
+
+    Sequence s(encoded.c_str(), encoded.size(), opts);
+    uint64_t checksum = 0;
+
+    allocation_counter counter;
+
+    for (auto offset: offsets)
+    {
+        auto en = s.deserialize_at(offset);
+
+        for (size_t i = 0; i < en.size(); ++i, en.next())
+            checksum += en.docid();
+
+        en.move(en.size() - 1);
+        uint64_t last = en.docid();
+
+        en.reset();
+        en.next_geq(std::max(en.docid(), std::min(universe / 2, last)));
+        checksum += en.position();
+
+        en.move(en.size() / 2);
+        checksum += en.docid();
+    }
+
+    std::cout << "test_enumerator_allocations(" << name << "): "
+              << counter.count() << " allocations (checksum " << checksum << ")" << std::endl;
+
+    BOOST_REQUIRE_EQUAL(counter.count(), 0);
+}
+
+template <typename Index>
+void test_query_allocations(const char *name)
+{
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+
+    if (!bfs::create_directory(test_root, ec) || ec) {
+        std::cout << "Failed creating " << test_root << ": " << ec.message() << std::endl;
+        BOOST_ERROR("Unable to create temp directory");
+        return;
+    }
+
+    bfs::path index_path(test_root / "index");
+
+    uint64_t universe = 2000;
+    sequences::options opts(universe);
+
+    {
+        Index index(opts, index_path.c_str());
+        typename Index::builder builder(index);
+
+        for (uint64_t docid = 0; docid < universe; ++docid)
+        {
+            std::vector<uint64_t> friends = random_sequence(universe, 1 + rand() % 300);
+            std::string encoded;
+
+            Index::sequence_type::serialize(encoded, opts, friends.size(), friends.begin());
+            builder.append(docid, encoded, friends.size());
+        }
+
+        builder.commit();
+    }
+
+    {
+        Index index(index_path.c_str());
+
+        intersection::solver<Index, Schemes::asindex> asindex(index);
+        intersection::solver<Index, Schemes::hopping> hopping(index);
+
+        std::vector<uint64_t> result;
+        result.reserve(1 << 20);
+
+        graphs::Edges edges;
+        edges.second.reserve(1 << 20);
+
+        allocation_counter counter;
+
+        for (uint64_t docid = 0; docid < universe; docid += 7)
+        {
+            int l = rand() % universe;
+            int r = l + rand() % (universe - l) + 1;
+
+            result.clear();
+            asindex.solve(docid, l, r, result);
+
+            result.clear();
+            hopping.solve(docid, l, r, result);
+
+            neighbors(index, docid, edges, 2);
+        }
+
+        std::cout << "test_query_allocations(" << name << "): "
+                  << counter.count() << " allocations" << std::endl;
+
+        BOOST_REQUIRE_EQUAL(counter.count(), 0);
+    }
+
+    bfs::remove_all(test_root);
+}
+
+#define LOOP_BODY(R, DATA, T)                                                   \
+    BOOST_AUTO_TEST_CASE(BOOST_PP_CAT(enumerator_allocations_, T)) {            \
+        test_enumerator_allocations<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T)); \
+    }
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SEQ_TYPES);
+#undef LOOP_BODY
+
+#define LOOP_BODY(R, DATA, T)                                                     \
+    BOOST_AUTO_TEST_CASE(BOOST_PP_CAT(query_allocations_, T)) {                   \
+        test_query_allocations<BOOST_PP_CAT(T, _simple_index)>(BOOST_STRINGIZE(T)); \
+    }
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SEQ_TYPES);
+#undef LOOP_BODY
@@ -0,0 +1,139 @@
+#define BOOST_TEST_MODULE dedup
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <vector>
+#include "ps/problems/dedup.hpp"
+#include "perftest_common.hpp"
+
+using namespace ps::problems;
+
+// Hits of a FoF query: num_runs sorted lists of docids in [l, l + width)
+static void random_runs(std::vector<uint64_t>& hits, std::vector<size_t>& ends,
+                        size_t num_runs, size_t max_run, uint64_t l, uint64_t width)
+{
+    for (size_t i = 0; i < num_runs; ++i) {
+        size_t start = hits.size();
+        size_t n = rand() % (max_run + 1);
+        for (size_t j = 0; j < n; ++j)
+            hits.push_back(l + (uint64_t(rand()) << 31 | rand()) % width);
+        std::sort(hits.begin() + start, hits.end());
+        ends.push_back(hits.size());
+    }
+}
+
+static void expected_dedup(std::vector<uint64_t>& hits, size_t begin, uint64_t exclude)
+{
+    std::sort(hits.begin() + begin, hits.end());
+    hits.erase(std::unique(hits.begin() + begin, hits.end()), hits.end());
+    hits.erase(std::remove(hits.begin() + begin, hits.end(), exclude), hits.end());
+}
+
+BOOST_AUTO_TEST_CASE(dedup_methods)
+{
+    const run_dedup::method methods[] = {
+        run_dedup::sort, run_dedup::bitmap, run_dedup::merge, run_dedup::radix};
+
+    run_dedup dedup;
+
+    for (int iter = 0; iter < 200; ++iter) {
+        size_t num_runs = rand() % 50;
+        uint64_t l = rand() % 1000000;
+        uint64_t width = 1 + rand() % (iter % 2 ? 100 : 1000000);
+
+        // a few hits that are not part of the runs stay in front
+        std::vector<uint64_t> input = {7, 3, 5};
+        std::vector<size_t> ends;
+        random_runs(input, ends, num_runs, 100, l, width);
+
+        uint64_t exclude = input.size() > 3 ? input[3 + rand() % (input.size() - 3)] : 0;
+        std::vector<uint64_t> expected(input);
+        expected_dedup(expected, 3, exclude);
+
+        for (auto m : methods) {
+            std::vector<uint64_t> hits(input);
+            dedup.reset(3);
+            for (auto end : ends)
+                dedup.add_run(end);
+
+            dedup.apply(hits, exclude, m);
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                            hits.begin(), hits.end());
+        }
+
+        std::vector<uint64_t> hits(input);
+        dedup.reset(3);
+        for (auto end : ends)
+            dedup.add_run(end);
+
+        dedup.apply(hits, exclude);
+        BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                        hits.begin(), hits.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dedup_choice)
+{
+    BOOST_REQUIRE_EQUAL(run_dedup::choose(10, 3, 1000000), run_dedup::sort);
+    // dense hits in a narrow prefix
+    BOOST_REQUIRE_EQUAL(run_dedup::choose(100000, 1000, 200000), run_dedup::bitmap);
+    // two long runs over a very wide span
+    BOOST_REQUIRE_EQUAL(run_dedup::choose(100000, 2, 1ULL << 40), run_dedup::merge);
+    // many runs over the whole universe
+    BOOST_REQUIRE_EQUAL(run_dedup::choose(100000, 5000, 1ULL << 30), run_dedup::radix);
+}
+
+// Large prefix FoF queries: a hub with many friends whose lists fall in a
+// wide range of the universe
+BOOST_AUTO_TEST_CASE(dedup_throughput)
+{
+    struct shape {
+        const char* name;
+        size_t num_runs;
+        size_t max_run;
+        uint64_t width;
+    };
+
+    const shape shapes[] = {
+        {"1000 friends, 1M wide prefix", 1000, 200, 1 << 20},
+        {"1000 friends, 64M wide prefix", 1000, 200, 1 << 26},
+        {"8 friends, 64M wide prefix", 8, 20000, 1 << 26},
+        {"2 friends, 1T wide prefix", 2, 50000, 1ULL << 40},
+    };
+
+    const int queries = 20;
+    run_dedup dedup;
+
+    for (auto const& s : shapes) {
+        std::vector<uint64_t> input;
+        std::vector<size_t> ends;
+        random_runs(input, ends, s.num_runs, s.max_run, 0, s.width);
+
+        std::cerr << s.name << ": hits=" << input.size()
+                  << " chosen=" << run_dedup::choose(input.size(), ends.size(), s.width)
+                  << std::endl;
+
+        std::vector<uint64_t> hits;
+
+        TIMEIT("  std::sort + unique", queries) {
+            for (int q = 0; q < queries; ++q) {
+                hits = input;
+                expected_dedup(hits, 0, uint64_t(-1));
+            }
+        }
+
+        const char* names[] = {"  sort", "  bitmap", "  merge", "  radix"};
+        for (int m = run_dedup::sort; m <= run_dedup::radix; ++m) {
+            TIMEIT(names[m], queries) {
+                for (int q = 0; q < queries; ++q) {
+                    hits = input;
+                    dedup.reset(0);
+                    for (auto end : ends)
+                        dedup.add_run(end);
+                    dedup.apply(hits, uint64_t(-1), run_dedup::method(m));
+                }
+            }
+        }
+    }
+}
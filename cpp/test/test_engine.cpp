@@ -0,0 +1,220 @@
+#define BOOST_TEST_MODULE engine
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <fstream>
+#include <vector>
+
+#include "test/perftest_common.hpp"
+
+#include "ps/engine.hpp"
+#include "ps/graphs/graph_types.hpp"
+#include "ps/graphs/serializer.hpp"
+
+using namespace ps;
+using namespace ps::graphs;
+using namespace ps::indices;
+using namespace ps::problems;
+namespace bfs = boost::filesystem;
+
+struct engine_fixture {
+    engine_fixture()
+    {
+        boost::system::error_code ec;
+        root = bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%");
+        BOOST_REQUIRE(bfs::create_directory(root, ec) && !ec);
+
+        {
+            gz_graph graph("test_data/simple-test.tsv.gz");
+            ef_simple_index index(sequences::options(6), (root / "index").c_str());
+            graph_serializer<gz_graph, ef_simple_index> serializer(graph, index);
+        }
+
+        // one name per sort id, in lexicographic order
+        std::ofstream dict((root / "dict").string());
+        for (auto name : {"ab", "abc", "b", "ba", "bb", "c"})
+            dict << name << std::endl;
+
+        cfg.index_type = "ef_simple";
+        cfg.index = (root / "index").string();
+        cfg.dict_type = "strarray";
+        cfg.dictionary = (root / "dict").string();
+    }
+
+    ~engine_fixture()
+    {
+        boost::system::error_code ec;
+        bfs::remove_all(root, ec);
+    }
+
+    std::vector<engine::query> all_queries(Scheme scheme)
+    {
+        std::vector<engine::query> queries;
+        for (uint64_t user = 0; user < 6; ++user)
+            for (auto prefix : {"a", "ab", "b", "ba", "c", "x"})
+                queries.emplace_back(user, prefix, scheme);
+        return queries;
+    }
+
+    bfs::path root;
+    engine::config cfg;
+};
+
+BOOST_FIXTURE_TEST_CASE(engine_matches_solvers, engine_fixture)
+{
+    ef_simple_index index(cfg.index.c_str());
+    dicts::strarray_dict dictionary(cfg.dictionary.c_str());
+
+    cfg.threads = 4;
+    std::unique_ptr<engine> e = engine::open(cfg);
+    BOOST_REQUIRE_EQUAL(e->threads(), 4);
+
+    for (Scheme scheme : {Scheme::Hopping, Scheme::AsIndex}) {
+        std::vector<engine::query> queries = all_queries(scheme);
+        std::vector<std::vector<uint64_t>> results(queries.size());
+        std::vector<bool> seen(queries.size(), false);
+
+        e->run(queries, [&](size_t i, const engine::query&, const engine::result& res) {
+            BOOST_REQUIRE(res.error.empty());
+            results[i] = res.docids;
+            seen[i] = true;
+        });
+
+        for (size_t i = 0; i < queries.size(); ++i) {
+            BOOST_REQUIRE(seen[i]);
+
+            std::vector<uint64_t> expected;
+            auto range = dictionary.prefix_search(queries[i].prefix);
+            if (range.first != -1) {
+                if (scheme == Scheme::Hopping)
+                    intersection::solver<ef_simple_index, Schemes::hopping>(index).solve(
+                        queries[i].user, range.first, range.second, expected);
+                else
+                    intersection::solver<ef_simple_index, Schemes::asindex>(index).solve(
+                        queries[i].user, range.first, range.second, expected);
+            }
+
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                            results[i].begin(), results[i].end());
+
+            engine::result single;
+            e->execute(queries[i], single);
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                            single.docids.begin(), single.docids.end());
+        }
+    }
+
+    // coverage is not defined for simple indices
+    engine::result res;
+    e->execute(engine::query(0, "a", Scheme::Coverage), res);
+    BOOST_REQUIRE(!res.error.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(engine_throughput, engine_fixture)
+{
+    std::vector<engine::query> queries;
+    for (size_t i = 0; i < 5000; ++i)
+        for (auto& q : all_queries(Scheme::Hopping))
+            queries.push_back(q);
+
+    for (size_t threads : {0, 1, 2, 4}) {
+        cfg.threads = threads;
+        std::unique_ptr<engine> e = engine::open(cfg);
+        std::atomic<size_t> answered(0);
+
+        TIMEIT("engine threads=" + std::to_string(threads), queries.size()) {
+            e->run(queries, [&](size_t, const engine::query&, const engine::result&) {
+                answered++;
+            });
+        }
+
+        BOOST_REQUIRE_EQUAL(answered, queries.size());
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(engine_sessions, engine_fixture)
+{
+    cfg.threads = 0;
+    std::unique_ptr<engine> e = engine::open(cfg);
+
+    for (uint64_t user = 0; user < 6; ++user) {
+        engine::session s(*e, user, Scheme::Hopping);
+
+        // typing, backspace, then a different first letter
+        std::vector<std::string> keystrokes = {"a", "ab", "abc", "ab", "a", "b", "ba", "bx", "b"};
+        for (auto const& prefix : keystrokes) {
+            engine::result expected;
+            e->execute(engine::query(user, prefix, Scheme::Hopping), expected);
+
+            const engine::result& res = s.type(prefix);
+            BOOST_REQUIRE(res.error.empty());
+            BOOST_REQUIRE_EQUAL(res.l, expected.l);
+            BOOST_REQUIRE_EQUAL(res.r, expected.r);
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.docids.begin(), expected.docids.end(),
+                                            res.docids.begin(), res.docids.end());
+        }
+
+        // only the first letters are solved
+        BOOST_REQUIRE_EQUAL(s.solved(), 2);
+        BOOST_REQUIRE_EQUAL(s.narrowed(), 4);
+        BOOST_REQUIRE_EQUAL(s.depth(), 1);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(engine_planner, engine_fixture)
+{
+    // sort ids are dictionary positions, so the remapping is the identity
+    {
+        std::ofstream file((root / "remapping.gz").string(), std::ios_base::binary);
+        boost::iostreams::filtering_ostream out;
+        out.push(boost::iostreams::gzip_compressor());
+        out.push(file);
+        for (int i = 0; i < 6; ++i)
+            out << i << "\n";
+    }
+    cfg.dict_remapping = (root / "remapping.gz").string();
+    cfg.threads = 0;
+
+    std::unique_ptr<engine> fixed = engine::open(cfg);
+    cfg.plan = true;
+    std::unique_ptr<engine> planned = engine::open(cfg);
+
+    for (Scheme scheme : {Scheme::Hopping, Scheme::AsIndex}) {
+        std::vector<engine::query> queries = all_queries(scheme);
+        planned->calibrate(queries);
+
+        for (auto const& q : queries) {
+            engine::result expected, res;
+            fixed->execute(q, expected);
+            planned->execute(q, res);
+
+            BOOST_REQUIRE(res.error.empty());
+            BOOST_REQUIRE(problem_of(res.scheme) == problem_of(scheme));
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.docids.begin(), expected.docids.end(),
+                                            res.docids.begin(), res.docids.end());
+        }
+    }
+
+    std::string explain = planned->explain(engine::query(0, "b", Scheme::Hopping));
+    std::cout << explain;
+    BOOST_REQUIRE(explain.find("  * ") != std::string::npos);
+    BOOST_REQUIRE(explain.find("fast-baseline-hopping") != std::string::npos);
+    BOOST_REQUIRE(explain.find("coverage") == std::string::npos);
+    BOOST_REQUIRE_EQUAL(planned->explain(engine::query(0, "x", Scheme::Hopping)),
+                        "No match for the prefix\n");
+
+    // a narrow range favours scanning it, a wide one favours hopping
+    ef_simple_index index(cfg.index.c_str());
+    planner<ef_simple_index> p(index, true, false);
+
+    query_stats stats = {1000, 100000, -1, 2, 2e-6, 0};
+    BOOST_REQUIRE_LT(p.estimate(Scheme::BaselineHopping, stats), p.estimate(Scheme::Hopping, stats));
+
+    stats.width = 1000000;
+    stats.fraction = 1.0;
+    BOOST_REQUIRE_LT(p.estimate(Scheme::Hopping, stats), p.estimate(Scheme::BaselineHopping, stats));
+}
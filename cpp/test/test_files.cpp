@@ -42,3 +42,55 @@ BOOST_AUTO_TEST_CASE(files)
 
     bfs::remove_all(test_root);
 }
+
+BOOST_AUTO_TEST_CASE(mapping_policies)
+{
+    std::string spec = "random;.off=willneed,mlock;.pos=random,hugepages,prefault;rmq.pos=sequential";
+
+    mapping_policy other = mapping_policy::for_file("index.deg", spec);
+    BOOST_REQUIRE_EQUAL(other.advice, random_access_file::RANDOM);
+    BOOST_REQUIRE(!other.lock && !other.prefault && !other.hugepages);
+
+    mapping_policy off = mapping_policy::for_file("index.off", spec);
+    BOOST_REQUIRE_EQUAL(off.advice, random_access_file::WILLNEED);
+    BOOST_REQUIRE(off.lock && !off.prefault);
+
+    mapping_policy pos = mapping_policy::for_file("index.pos", spec);
+    BOOST_REQUIRE(pos.hugepages && pos.prefault && !pos.lock);
+
+    // the longest matching suffix wins
+    mapping_policy rmq = mapping_policy::for_file("index.rmq.pos", spec);
+    BOOST_REQUIRE_EQUAL(rmq.advice, random_access_file::SEQUENTIAL);
+    BOOST_REQUIRE(!rmq.prefault);
+
+    BOOST_REQUIRE_EQUAL(mapping_policy::for_file("index.pos", "").advice, random_access_file::NORMAL);
+    BOOST_REQUIRE_THROW(mapping_policy::parse("random,bogus"), std::runtime_error);
+
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+
+    if (!bfs::create_directory(test_root, ec) || ec) {
+        std::cout << "Failed creating " << test_root << ": " << ec.message() << std::endl;
+        BOOST_ERROR("Unable to create temp directory");
+        return;
+    }
+
+    bfs::path tempfile(test_root / "database.pos");
+    std::string contents;
+    for (size_t i = 0; i < (1 << 20); ++i)
+        contents.push_back(static_cast<char>(i * 7));
+
+    std::unique_ptr<writable_file> file;
+    new_writable_file(tempfile.string(), &file);
+    file->append(contents);
+    file->close();
+
+    {
+        boost::iostreams::mapped_file_source mapped(tempfile.string());
+        apply_mapping_policy(tempfile.string(), mapped.data(), mapped.size(),
+                             mapping_policy::parse("willneed,prefault,mlock"), 3);
+        BOOST_REQUIRE(std::equal(contents.begin(), contents.end(), mapped.data()));
+    }
+
+    bfs::remove_all(test_root);
+}
@@ -5,6 +5,9 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <fstream>
 #include <vector>
 
 #include "test/test_generic_sequence.hpp"
@@ -15,6 +18,8 @@
 #include "ps/sequences/options.hpp"
 #include "ps/indices/index_types.hpp"
 #include "ps/indices/neighbors.hpp"
+#include "ps/problems/intersection.hpp"
+#include "ps/problems/topk.hpp"
 
 
 using namespace ps;
@@ -91,8 +96,535 @@ BOOST_AUTO_TEST_CASE(BOOST_PP_CAT(test_index_file_, T)) {         \
 }
 
 BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SIMPLE_INDEX_TYPES);
+BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_COVERAGE_INDEX_TYPES);
 #undef LOOP_BODY
 
+template <typename Index>
+void test_lazy_nodes(const char *name)
+{
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+
+    if (!bfs::create_directory(test_root, ec) || ec) {
+        cout << "Failed creating " << test_root << ": " << ec.message() << endl;
+        BOOST_ERROR("Unable to create temp directory");
+        return;
+    }
+
+    bfs::path index_path(test_root / "index");
+
+    std::cout << "Testing lazy node lookups using " << name << " encoding" << std::endl;
+
+    uint64_t universe = 100000;
+    sequences::options opts(universe);
+
+    {
+        Index index(opts, index_path.c_str());
+        typename Index::builder builder(index);
+
+        for (uint64_t docid = 0; docid < universe; docid += 1 + rand() % 3)
+        {
+            std::vector<uint64_t> friends = random_sequence(universe, 1 + rand() % 50);
+            std::string encoded;
+
+            Index::sequence_type::serialize(encoded, opts, friends.size(), friends.begin());
+            builder.append(docid, encoded, friends.size());
+        }
+
+        builder.commit();
+    }
+
+    Index materialized(index_path.c_str(), false);
+    Index lazy(index_path.c_str(), true);
+
+    BOOST_REQUIRE_EQUAL(materialized.num_docs(), lazy.num_docs());
+    BOOST_REQUIRE_EQUAL(lazy.nodes().memory_bytes(), 0);
+
+    for (uint64_t docid = 0; docid < universe; ++docid)
+    {
+        uint64_t expected_offset, offset;
+
+        BOOST_REQUIRE_EQUAL(materialized.degree(docid), lazy.degree(docid));
+        BOOST_REQUIRE_EQUAL(materialized.get_offset(docid, expected_offset),
+                            lazy.get_offset(docid, offset));
+        BOOST_REQUIRE_EQUAL(expected_offset, offset);
+    }
+
+    std::vector<uint64_t> docids(1000000);
+
+    for (auto& docid: docids)
+        docid = rand() % universe;
+
+    uint64_t checksum[2] = {0, 0};
+
+    TIMEIT("Materialized get_offset() + degree()", docids.size())
+    {
+        for (auto docid: docids)
+        {
+            uint64_t offset;
+            materialized.get_offset(docid, offset);
+            checksum[0] += offset + materialized.degree(docid);
+        }
+    }
+
+    TIMEIT("Lazy get_offset() + degree()", docids.size())
+    {
+        for (auto docid: docids)
+        {
+            uint64_t offset;
+            lazy.get_offset(docid, offset);
+            checksum[1] += offset + lazy.degree(docid);
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(checksum[0], checksum[1]);
+
+    bfs::remove_all(test_root);
+}
+
+BOOST_AUTO_TEST_CASE(test_lazy_nodes_ef)
+{
+    test_lazy_nodes<ef_simple_index>("ef");
+}
+
+template <typename Sequence>
+void test_cached_index(const char *name)
+{
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+
+    if (!bfs::create_directory(test_root, ec) || ec) {
+        cout << "Failed creating " << test_root << ": " << ec.message() << endl;
+        BOOST_ERROR("Unable to create temp directory");
+        return;
+    }
+
+    bfs::path index_path(test_root / "index");
+
+    std::cout << "Testing cached index using " << name << " encoding" << std::endl;
+
+    uint64_t universe = 50000;
+    sequences::options opts(universe);
+
+    {
+        simple_index<Sequence> index(opts, index_path.c_str());
+        typename simple_index<Sequence>::builder builder(index);
+
+        for (uint64_t docid = 0; docid < universe; docid += 1 + rand() % 3)
+        {
+            std::vector<uint64_t> friends = random_sequence(universe, 1 + rand() % (rand() % 100 ? 50 : 5000));
+            std::string encoded;
+
+            Sequence::serialize(encoded, opts, friends.size(), friends.begin());
+            builder.append(docid, encoded, friends.size());
+        }
+
+        builder.commit();
+    }
+
+    simple_index<Sequence> mapped(index_path.c_str());
+    // a few chunks only, so that the checks below go through evictions
+    cached_index<Sequence> cached(index_path.c_str(), 1 << 20);
+
+    BOOST_REQUIRE_EQUAL(mapped.num_docs(), cached.num_docs());
+    BOOST_REQUIRE_EQUAL(mapped.num_elements(), cached.num_elements());
+
+    for (size_t pass = 0; pass < 2; ++pass)
+    {
+        for (uint64_t docid = 0; docid < universe; ++docid)
+        {
+            Edges expected, edges;
+            BOOST_REQUIRE_EQUAL(neighbors(mapped, docid, expected), neighbors(cached, docid, edges));
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.second.begin(), expected.second.end(),
+                                            edges.second.begin(), edges.second.end());
+        }
+    }
+
+    // a single lookup touches at most the chunks its list spans
+    files::block_cache::stats before = files::block_cache::thread_stats();
+    Edges edges;
+    neighbors(cached, 0, edges);
+    files::block_cache::stats query = files::block_cache::thread_stats() - before;
+    BOOST_REQUIRE_GE(query.hits + query.misses, 1);
+
+    std::cout << cached << std::endl;
+    BOOST_REQUIRE_GT(cached.cache().totals().hit_ratio(), 0);
+
+    bfs::remove_all(test_root);
+}
+
+BOOST_AUTO_TEST_CASE(test_cached_index_block_optpfor)
+{
+    test_cached_index<sequences::block_optpfor_seq>("block_optpfor");
+}
+
+BOOST_AUTO_TEST_CASE(test_cached_index_opt)
+{
+    test_cached_index<sequences::opt_seq>("opt");
+}
+
+BOOST_AUTO_TEST_CASE(test_cached_index_hybrid)
+{
+    test_cached_index<sequences::hybrid_seq>("hybrid");
+}
+
+// Replays a list of edges, throwing after fail_after of them to simulate an
+// interrupted build
+struct vector_graph {
+    vector_graph(const std::vector<Edge>& edges, size_t fail_after = size_t(-1))
+        : m_edges(edges)
+        , m_pos(0)
+        , m_fail_after(fail_after)
+    {}
+
+    bool get_next(Edge& edge)
+    {
+        if (m_pos == m_fail_after)
+            throw std::runtime_error("interrupted");
+        if (m_pos == m_edges.size())
+            return false;
+
+        edge = m_edges[m_pos++];
+        return true;
+    }
+
+    const std::vector<Edge>& m_edges;
+    size_t m_pos;
+    size_t m_fail_after;
+};
+
+template <typename Index>
+void test_segmented_build(const char *name)
+{
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+
+    if (!bfs::create_directory(test_root, ec) || ec) {
+        cout << "Failed creating " << test_root << ": " << ec.message() << endl;
+        BOOST_ERROR("Unable to create temp directory");
+        return;
+    }
+
+    std::string serial_path((test_root / "serial").string());
+    std::string segmented_path((test_root / "segmented").string());
+
+    std::cout << "Testing segmented build using " << name << " encoding" << std::endl;
+
+    uint64_t universe = 20000;
+    sequences::options opts(universe);
+
+    std::vector<Edge> edges;
+    for (uint64_t docid = 0; docid < universe; docid += 1 + rand() % 3)
+    {
+        for (uint64_t friend_id : random_sequence(universe, 1 + rand() % 50))
+            edges.emplace_back(docid, friend_id);
+    }
+
+    {
+        vector_graph graph(edges);
+        Index index(opts, serial_path.c_str());
+        graph_serializer<vector_graph, Index> serializer(graph, index);
+    }
+
+    // the first build stops half way, the second one picks up the segments
+    // it completed
+    {
+        vector_graph graph(edges, edges.size() / 2);
+        Index index(opts, segmented_path.c_str());
+        BOOST_REQUIRE_THROW((segmented_graph_serializer<vector_graph, Index>(
+                                 graph, index, segmented_path, 8)),
+                            std::runtime_error);
+    }
+
+    {
+        vector_graph graph(edges);
+        Index index(opts, segmented_path.c_str());
+        segmented_graph_serializer<vector_graph, Index> serializer(graph, index, segmented_path, 8);
+        BOOST_REQUIRE_GT(serializer.reused_segments(), 0);
+    }
+
+    Index serial(serial_path.c_str());
+    Index segmented(segmented_path.c_str());
+
+    BOOST_REQUIRE_EQUAL(serial.num_docs(), segmented.num_docs());
+    BOOST_REQUIRE_EQUAL(serial.num_elements(), segmented.num_elements());
+
+    for (uint64_t docid = 0; docid < universe; ++docid)
+    {
+        uint64_t serial_offset, segmented_offset;
+
+        BOOST_REQUIRE_EQUAL(serial.get_offset(docid, serial_offset),
+                            segmented.get_offset(docid, segmented_offset));
+        BOOST_REQUIRE_EQUAL(serial.degree(docid), segmented.degree(docid));
+
+        if (!serial.degree(docid))
+            continue;
+
+        auto expected = serial.sequence_at(serial_offset);
+        auto en = segmented.sequence_at(segmented_offset);
+        BOOST_REQUIRE_EQUAL(expected.size(), en.size());
+
+        for (size_t i = 0; i < en.size(); ++i, en.next(), expected.next())
+            BOOST_REQUIRE_EQUAL(expected.docid(), en.docid());
+    }
+
+    bfs::remove_all(test_root);
+}
+
+BOOST_AUTO_TEST_CASE(test_segmented_build_ef)
+{
+    test_segmented_build<ef_simple_index>("ef");
+}
+
+BOOST_AUTO_TEST_CASE(test_segmented_build_reference)
+{
+    test_segmented_build<reference_simple_index>("reference");
+}
+
+template <typename Index>
+void test_coverage_index(const char *name)
+{
+    using namespace ps::problems;
+
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+
+    if (!bfs::create_directory(test_root, ec) || ec) {
+        cout << "Failed creating " << test_root << ": " << ec.message() << endl;
+        BOOST_ERROR("Unable to create temp directory");
+        return;
+    }
+
+    std::cout << "Testing coverage index using " << name << " encoding" << std::endl;
+
+    uint64_t universe = 5000;
+    sequences::options opts(universe);
+
+    // a few hubs among many users with small degrees
+    std::vector<Edge> edges;
+    for (uint64_t docid = 0; docid < universe; docid += 1 + rand() % 2)
+    {
+        size_t degree = (docid % 97 == 0) ? 500 + rand() % 500 : 1 + rand() % 20;
+        for (uint64_t friend_id : random_sequence(universe, degree))
+            edges.emplace_back(docid, friend_id);
+    }
+
+    for (double budget : {0.0, 0.5, 1000.0})
+    {
+        std::string path((test_root / ("index-" + std::to_string(budget))).string());
+
+        {
+            vector_graph graph(edges);
+            Index index(opts, path.c_str(), budget);
+            graph_serializer<vector_graph, Index> serializer(graph, index);
+        }
+
+        Index index(path.c_str());
+        intersection::solver<Index, Schemes::hopping> hopping(index);
+        intersection::solver<Index, Schemes::coverage> coverage(index);
+
+        uint64_t materialized = 0, max_cost_left_out = 0, min_cost_in = uint64_t(-1);
+        std::vector<uint64_t> expected, result;
+
+        for (uint64_t docid = 0; docid < universe; ++docid)
+        {
+            uint64_t offset;
+            if (index.get_offset(docid, offset)) {
+                uint64_t cost = index.degree(docid);
+                auto en = index.sequence_at(offset);
+                for (size_t i = 0; i < en.size(); ++i, en.next())
+                    cost += index.degree(en.docid());
+
+                if (index.get_coverage_offset(docid, offset)) {
+                    materialized++;
+                    min_cost_in = std::min(min_cost_in, cost);
+                } else {
+                    max_cost_left_out = std::max(max_cost_left_out, cost);
+                }
+            }
+
+            int l = rand() % universe;
+            int r = l + rand() % (universe - l + 1);
+
+            for (auto range : {std::make_pair(0, int(universe)), std::make_pair(l, r)})
+            {
+                expected.clear();
+                result.clear();
+                hopping.solve(docid, range.first, range.second, expected);
+                coverage.solve(docid, range.first, range.second, result);
+
+                BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                                result.begin(), result.end());
+            }
+        }
+
+        std::cout << "budget=" << budget << " materialized=" << materialized << std::endl;
+
+        if (budget == 0.0)
+            BOOST_REQUIRE_EQUAL(materialized, 0);
+        else
+            BOOST_REQUIRE_GT(materialized, 0);
+
+        // the most expensive users are the ones materialized
+        if (budget == 0.5)
+            BOOST_REQUIRE_GE(min_cost_in, max_cost_left_out);
+    }
+
+    bfs::remove_all(test_root);
+}
+
+BOOST_AUTO_TEST_CASE(test_coverage_index_ef)
+{
+    test_coverage_index<ef_coverage_index>("ef");
+}
+
+BOOST_AUTO_TEST_CASE(test_coverage_index_reference)
+{
+    test_coverage_index<reference_coverage_index>("reference");
+}
+
+// Hub queries split across threads give the results of a single thread
+BOOST_AUTO_TEST_CASE(test_parallel_hubs)
+{
+    using namespace ps::problems;
+
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+
+    if (!bfs::create_directory(test_root, ec) || ec) {
+        cout << "Failed creating " << test_root << ": " << ec.message() << endl;
+        BOOST_ERROR("Unable to create temp directory");
+        return;
+    }
+
+    uint64_t universe = 20000;
+    sequences::options opts(universe);
+
+    std::vector<Edge> edges;
+    for (uint64_t docid = 0; docid < universe; docid += 1 + rand() % 2)
+    {
+        size_t degree = (docid % 199 == 0) ? 2000 + rand() % 3000 : 1 + rand() % 50;
+        for (uint64_t friend_id : random_sequence(universe, degree))
+            edges.emplace_back(docid, friend_id);
+    }
+
+    // distinct ranks, and WAND bounds that are the best rank of each list
+    std::vector<uint64_t> ranking(universe), wand(universe, 0);
+    for (uint64_t docid = 0; docid < universe; ++docid)
+        ranking[docid] = docid;
+    std::random_shuffle(ranking.begin(), ranking.end());
+    for (auto const& e : edges)
+        wand[e.first] = std::max(wand[e.first], ranking[e.second]);
+
+    std::string ranking_path((test_root / "ranking.gz").string());
+    {
+        std::ofstream file(ranking_path, std::ios_base::binary);
+        boost::iostreams::filtering_ostream out;
+        out.push(boost::iostreams::gzip_compressor());
+        out.push(file);
+        for (uint64_t docid = 0; docid < universe; ++docid)
+            out << docid << "\t" << ranking[docid] << "\n";
+    }
+
+    std::string simple_path((test_root / "simple").string());
+    std::string topk_path((test_root / "topk").string());
+    {
+        vector_graph graph(edges);
+        ef_simple_index index(opts, simple_path.c_str());
+        graph_serializer<vector_graph, ef_simple_index> serializer(graph, index);
+    }
+    {
+        vector_graph graph(edges);
+        ef_topk_index index(opts, topk_path.c_str(), ranking_path.c_str());
+        graph_serializer<vector_graph, ef_topk_index> serializer(graph, index);
+    }
+
+    ef_simple_index simple(simple_path.c_str());
+    ef_topk_index ranked(topk_path.c_str());
+
+    // the first of each pair never splits, the second splits every hub
+    const size_t never = size_t(-1);
+    const int k = 10;
+
+    intersection::solver<ef_simple_index, Schemes::hopping> hopping[2] = {simple, simple};
+    problems::topk::solver<ef_simple_index, Schemes::topk_hopping> topk_hopping[2] = {
+        {simple, ranking, wand, k}, {simple, ranking, wand, k}};
+    problems::topk::solver<ef_simple_index, Schemes::topk_hopping_wand> topk_wand[2] = {
+        {simple, ranking, wand, k}, {simple, ranking, wand, k}};
+    problems::topk::solver<ef_topk_index, Schemes::topk_hopping_rmq> topk_rmq[2] = {
+        {ranked, ranking, wand, k}, {ranked, ranking, wand, k}};
+
+    hopping[0].set_parallel(never, 0);
+    topk_hopping[0].set_parallel(never, 0);
+    topk_wand[0].set_parallel(never, 0);
+    topk_rmq[0].set_parallel(never, 0);
+    hopping[1].set_parallel(1000, 0);
+    topk_hopping[1].set_parallel(1000, 0);
+    topk_wand[1].set_parallel(1000, 0);
+    topk_rmq[1].set_parallel(1000, 0);
+
+    std::vector<uint64_t> results[2];
+    size_t hubs = 0;
+
+    for (uint64_t docid = 0; docid < universe; docid += 1 + rand() % 5)
+    {
+        hubs += simple.degree(docid) >= 1000;
+
+        int l = rand() % universe;
+        int r = l + rand() % (universe - l + 1);
+
+        for (auto range : {std::make_pair(0, int(universe)), std::make_pair(l, r)})
+        {
+            for (int i = 0; i < 2; ++i) {
+                results[i].clear();
+                hopping[i].solve(docid, range.first, range.second, results[i]);
+            }
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(results[0].begin(), results[0].end(),
+                                            results[1].begin(), results[1].end());
+
+            for (int i = 0; i < 2; ++i) {
+                results[i].assign(k, 0);
+                topk_hopping[i].solve(docid, range.first, range.second, results[i]);
+            }
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(results[0].begin(), results[0].end(),
+                                            results[1].begin(), results[1].end());
+
+            for (int i = 0; i < 2; ++i) {
+                results[i].assign(k, 0);
+                topk_wand[i].solve(docid, range.first, range.second, results[i]);
+            }
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(results[0].begin(), results[0].end(),
+                                            results[1].begin(), results[1].end());
+
+            for (int i = 0; i < 2; ++i) {
+                results[i].assign(k, 0);
+                topk_rmq[i].solve(docid, range.first, range.second, results[i]);
+            }
+            BOOST_REQUIRE_EQUAL_COLLECTIONS(results[0].begin(), results[0].end(),
+                                            results[1].begin(), results[1].end());
+        }
+    }
+
+    BOOST_REQUIRE_GT(hubs, 0);
+
+    // a hub query timed on one thread and split
+    uint64_t hub = 0;
+    for (uint64_t docid = 0; docid < universe; ++docid)
+        if (simple.degree(docid) > simple.degree(hub))
+            hub = docid;
+
+    for (int i = 0; i < 2; ++i) {
+        TIMEIT(i ? "Hub hopping, split" : "Hub hopping, one thread", 20) {
+            for (int q = 0; q < 20; ++q) {
+                results[i].clear();
+                hopping[i].solve(hub, 0, universe, results[i]);
+            }
+        }
+    }
+
+    bfs::remove_all(test_root);
+}
+
 template <typename GraphType, typename Index>
 void test_topk_index(const char *name)
 {
@@ -231,6 +763,19 @@ void test_topk_index(const char *name)
         }
     }
 
+    {
+        Index materialized(index_path.c_str(), false);
+        Index lazy(index_path.c_str(), true);
+
+        for (uint64_t docid = 0; docid < materialized.num_docs(); ++docid)
+        {
+            BOOST_REQUIRE_EQUAL(materialized.nodes().offset(docid), lazy.nodes().offset(docid));
+            BOOST_REQUIRE_EQUAL(materialized.nodes().degree(docid), lazy.nodes().degree(docid));
+            BOOST_REQUIRE_EQUAL(materialized.nodes().cdf_degree(docid), lazy.nodes().cdf_degree(docid));
+            BOOST_REQUIRE_EQUAL(materialized.nodes().score(docid), lazy.nodes().score(docid));
+        }
+    }
+
     bfs::remove_all(test_root);
 }
 
@@ -0,0 +1,109 @@
+#define BOOST_TEST_MODULE protocol
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <thread>
+
+#include "ps/protocol.hpp"
+
+using namespace ps;
+namespace bfs = boost::filesystem;
+
+BOOST_AUTO_TEST_CASE(request_roundtrip)
+{
+    protocol::request req;
+    req.id = 1ULL << 40;
+    req.attribute = 513;
+    req.scheme = 7;
+    req.k = 10;
+    req.user = 123456789;
+    req.prefix = "fer";
+
+    std::string frame;
+    protocol::encode_request(frame, req);
+    BOOST_REQUIRE_EQUAL(frame.size(), 4 + protocol::request_header_size + 3);
+    BOOST_REQUIRE_EQUAL(coding::decode_fixed_32(frame.data()), frame.size() - 4);
+
+    protocol::request out;
+    BOOST_REQUIRE(protocol::decode_request(frame.data() + 4, frame.size() - 4, out));
+    BOOST_REQUIRE_EQUAL(out.id, req.id);
+    BOOST_REQUIRE_EQUAL(out.attribute, req.attribute);
+    BOOST_REQUIRE_EQUAL(out.scheme, req.scheme);
+    BOOST_REQUIRE_EQUAL(out.k, req.k);
+    BOOST_REQUIRE_EQUAL(out.user, req.user);
+    BOOST_REQUIRE_EQUAL(out.prefix, req.prefix);
+
+    BOOST_REQUIRE(!protocol::decode_request(frame.data() + 4, protocol::request_header_size - 1, out));
+}
+
+// A server answering every request with [0, user) in reverse order, as
+// responses are allowed to come back out of order
+BOOST_AUTO_TEST_CASE(pipelined_responses)
+{
+    boost::system::error_code ec;
+    std::string address = (bfs::temp_directory_path(ec) /
+                           bfs::unique_path("ps-%%%%-%%%%.sock")).string();
+    int listen_fd = protocol::open_socket(address, true);
+    const size_t num_requests = 64;
+
+    std::thread server([&]() {
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        std::vector<protocol::request> requests(num_requests);
+
+        for (auto& req : requests) {
+            char length[4];
+            BOOST_REQUIRE(protocol::read_full(fd, length, 4));
+            std::vector<char> body(coding::decode_fixed_32(length));
+            BOOST_REQUIRE(protocol::read_full(fd, body.data(), body.size()));
+            BOOST_REQUIRE(protocol::decode_request(body.data(), body.size(), req));
+        }
+
+        for (auto it = requests.rbegin(); it != requests.rend(); ++it) {
+            std::vector<uint64_t> docids(it->user);
+            for (uint64_t i = 0; i < it->user; ++i)
+                docids[i] = i;
+
+            char header[4 + protocol::response_header_size];
+            size_t bytes = docids.size() * sizeof(uint64_t);
+            protocol::encode_response_header(header, it->id, protocol::ok, 1, 2,
+                                             docids.size(), bytes);
+
+            struct iovec iov[2] = {{header, sizeof(header)}, {docids.data(), bytes}};
+            BOOST_REQUIRE(protocol::write_full(fd, iov, 2));
+        }
+
+        ::close(fd);
+    });
+
+    {
+        protocol::client client(address);
+        for (size_t i = 0; i < num_requests; ++i) {
+            protocol::request req;
+            req.id = i;
+            req.attribute = 0;
+            req.scheme = 0;
+            req.k = 0;
+            req.user = i * 100;
+            req.prefix = "p";
+            client.send(req);
+        }
+
+        protocol::response res;
+        for (size_t i = 0; i < num_requests; ++i) {
+            client.receive(res);
+            BOOST_REQUIRE_EQUAL(res.id, num_requests - 1 - i);
+            BOOST_REQUIRE_EQUAL(res.status, protocol::ok);
+            BOOST_REQUIRE_EQUAL(res.l, 1);
+            BOOST_REQUIRE_EQUAL(res.r, 2);
+            BOOST_REQUIRE_EQUAL(res.docids.size(), res.id * 100);
+            for (size_t j = 0; j < res.docids.size(); ++j)
+                BOOST_REQUIRE_EQUAL(res.docids[j], j);
+        }
+    }
+
+    server.join();
+    ::close(listen_fd);
+    ::unlink(address.c_str());
+}
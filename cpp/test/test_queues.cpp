@@ -2,6 +2,7 @@
 
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
+#include <atomic>
 #include "ps/queues.hpp"
 
 using namespace ps;
@@ -84,10 +85,90 @@ void test_queues()
     BOOST_REQUIRE(elapsed_ms <= 35);
 }
 
+class sequence_job : public job {
+public:
+    sequence_job(uint64_t seq, std::vector<uint64_t>& committed, std::atomic<int>& in_flight)
+        : m_seq(seq)
+        , m_committed(committed)
+        , m_in_flight(in_flight)
+    {}
+
+    void prepare(void* user_data)
+    {
+        m_in_flight++;
+        boost::this_thread::sleep(boost::posix_time::microseconds((m_seq * 7919) % 200));
+    }
+
+    void commit(void* user_data)
+    {
+        m_in_flight--;
+        m_committed.push_back(m_seq);
+    }
+
+private:
+    uint64_t m_seq;
+    std::vector<uint64_t>& m_committed;
+    std::atomic<int>& m_in_flight;
+};
+
+BOOST_AUTO_TEST_CASE(ordered_commit)
+{
+    const uint64_t num_jobs = 5000;
+    std::vector<uint64_t> committed;
+    std::atomic<int> in_flight(0);
+    int max_in_flight = 0;
+
+    {
+        ordered_queue q(4);
+        for (uint64_t i = 0; i < num_jobs; ++i) {
+            q.add_job(std::make_shared<sequence_job>(i, committed, in_flight), 1);
+            max_in_flight = std::max<int>(max_in_flight, in_flight);
+        }
+        q.complete();
+    }
+
+    BOOST_REQUIRE_EQUAL(committed.size(), num_jobs);
+    for (uint64_t i = 0; i < num_jobs; ++i)
+        BOOST_REQUIRE_EQUAL(committed[i], i);
+
+    // backpressure: a few batches per worker, not the whole input
+    size_t threads = std::max<size_t>(configuration::get().worker_threads, 1);
+    BOOST_REQUIRE(max_in_flight <= int(4 * threads * 4 + 4));
+}
+
+// Every task of every group runs exactly once, with callers racing on the
+// same pool
+BOOST_AUTO_TEST_CASE(task_pool_groups)
+{
+    task_pool pool(3);
+    const size_t callers = 4, tasks = 1000;
+    std::vector<std::atomic<int>> runs(callers * tasks);
+    for (auto& r : runs)
+        r = 0;
+
+    boost::thread_group threads;
+    for (size_t c = 0; c < callers; ++c) {
+        threads.create_thread([&, c]() {
+            for (size_t round = 0; round < 10; ++round)
+                pool.run(tasks, [&](size_t i) { runs[c * tasks + i]++; });
+        });
+    }
+    threads.join_all();
+
+    for (auto& r : runs)
+        BOOST_REQUIRE_EQUAL(r, 10);
+
+    task_pool inline_pool(0);
+    size_t count = 0;
+    inline_pool.run(tasks, [&](size_t i) { count++; });
+    BOOST_REQUIRE_EQUAL(count, tasks);
+}
+
 BOOST_AUTO_TEST_CASE(iterate_graph)
 {
     test_queues<ordered_queue>();
     test_queues<unordered_single_queue>();
     test_queues<unordered_multi_queue>();
+    test_queues<unordered_ring_queue>();
     test_blocking_queue();
 }
@@ -0,0 +1,62 @@
+#define BOOST_TEST_MODULE queues_throughput
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include "ps/queues.hpp"
+#include "perftest_common.hpp"
+
+using namespace ps;
+using namespace ps::queues;
+
+// One node of friends_at_k worth of work: a few hundred ns to prepare and a
+// shared counter to commit to
+class tiny_job : public job {
+public:
+    tiny_job(uint64_t value, uint64_t& sum)
+        : m_value(value)
+        , m_sum(sum)
+    {}
+
+    void prepare(void* user_data)
+    {
+        uint64_t x = m_value;
+        for (int i = 0; i < 64; ++i)
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        m_result = m_value + (x & 0);
+    }
+
+    void commit(void* user_data)
+    {
+        m_sum += m_result;
+    }
+
+private:
+    uint64_t m_value;
+    uint64_t m_result;
+    uint64_t& m_sum;
+};
+
+template <typename Queue>
+void benchmark_throughput(const std::string& name, uint64_t num_jobs)
+{
+    uint64_t sum = 0;
+
+    TIMEIT(name + " jobs", num_jobs) {
+        Queue q(1);
+        for (uint64_t i = 0; i < num_jobs; ++i)
+            q.add_job(std::make_shared<tiny_job>(i, sum), 1);
+        q.complete();
+    }
+
+    BOOST_REQUIRE_EQUAL(sum, num_jobs * (num_jobs - 1) / 2);
+}
+
+BOOST_AUTO_TEST_CASE(small_jobs)
+{
+    const uint64_t num_jobs = 200000;
+
+    benchmark_throughput<ordered_queue>("ordered", num_jobs);
+    benchmark_throughput<unordered_single_queue>("unordered_single", num_jobs);
+    benchmark_throughput<unordered_ring_queue>("unordered_ring", num_jobs);
+}
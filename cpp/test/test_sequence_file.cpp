@@ -94,3 +94,89 @@ BOOST_AUTO_TEST_CASE(BOOST_PP_CAT(test_sequence_file_, T)) {       \
 BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SEQ_TYPES);
 #undef LOOP_BODY
 
+template <typename Sequence>
+void write_correlated_sequences(const char *name,
+                                const bfs::path& path,
+                                const std::vector<std::vector<uint64_t>>& sequences,
+                                uint64_t universe)
+{
+    std::vector<uint64_t> offsets;
+    uint64_t elements = 0;
+
+    {
+        options opts(universe);
+        sequence_file<Sequence> seqfile(opts, path.c_str());
+        typename sequence_file<Sequence>::builder seq_builder(seqfile);
+
+        for (auto& sequence: sequences)
+        {
+            offsets.push_back(seq_builder.append(sequence.size(), sequence.begin()));
+            elements += sequence.size();
+        }
+
+        seq_builder.commit();
+    }
+
+    sequence_file<Sequence> seqfile(path.c_str());
+    std::cout << name << ": " << seqfile.contents_size() << " bytes, "
+              << (double)seqfile.contents_size() * 8 / elements << " bits/element" << std::endl;
+
+    TIMEIT(std::string("Decoding ") + name, elements)
+    {
+        for (size_t s = 0; s < sequences.size(); ++s)
+        {
+            auto en = seqfile.sequence_at(offsets[s]);
+            BOOST_REQUIRE_EQUAL(en.size(), sequences[s].size());
+
+            for (size_t i = 0; i < en.size(); ++i, en.next())
+                BOOST_REQUIRE_EQUAL(en.docid(), sequences[s][i]);
+        }
+    }
+
+    TIMEIT(std::string("next_geq ") + name, sequences.size())
+    {
+        for (size_t s = 0; s < sequences.size(); ++s)
+        {
+            auto en = seqfile.sequence_at(offsets[s]);
+            uint64_t median = sequences[s][sequences[s].size() / 2];
+
+            en.next_geq(median);
+            BOOST_REQUIRE_EQUAL(en.docid(), median);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_reference_correlated)
+{
+    boost::system::error_code ec;
+    bfs::path test_root(bfs::unique_path(bfs::temp_directory_path(ec) / "%%%%-%%%%-%%%%"));
+    BOOST_REQUIRE(bfs::create_directory(test_root, ec) && !ec);
+
+    // groups of consecutive lists sharing most of their elements, as nodes
+    // of the same community after reassign_ids
+    uint64_t universe = 1 << 20;
+    std::vector<std::vector<uint64_t>> sequences;
+    for (uint64_t group = 0; group < 50; ++group)
+    {
+        std::vector<uint64_t> shared = random_sequence(universe, 500);
+        for (uint64_t i = 0; i < 10; ++i)
+        {
+            std::vector<uint64_t> extra = random_sequence(universe, 50);
+            std::vector<uint64_t> sequence;
+            for (size_t j = 0; j < shared.size(); ++j)
+                if (rand() % 10)
+                    sequence.push_back(shared[j]);
+            sequence.insert(sequence.end(), extra.begin(), extra.end());
+
+            std::sort(sequence.begin(), sequence.end());
+            sequence.erase(std::unique(sequence.begin(), sequence.end()), sequence.end());
+            sequences.push_back(sequence);
+        }
+    }
+
+    write_correlated_sequences<reference_seq>("reference", test_root / "reference", sequences, universe);
+    write_correlated_sequences<opt_seq>("opt", test_root / "opt", sequences, universe);
+    write_correlated_sequences<block_optpfor_seq>("block_optpfor", test_root / "block_optpfor", sequences, universe);
+
+    bfs::remove_all(test_root);
+}
@@ -4,10 +4,13 @@
 #include <iostream>
 #include <vector>
 #include <list>
+#include <numeric>
 #include <boost/test/unit_test.hpp>
 #include "ps/queues.hpp"
 #include "ps/sequences/sequence_types.hpp"
+#include "ps/sequences/sequence_packer.hpp"
 #include "test/test_generic_sequence.hpp"
+#include "test/perftest_common.hpp"
 
 using namespace ps;
 using namespace ps::queues;
@@ -136,6 +139,247 @@ void test_encode_decode(const char * name)
               << "): " << output.size() << " bytes" << std::endl;
 }
 
+template <typename Sequence>
+void test_extract_range(const char * name)
+{
+    uint64_t universe = 20000;
+    options opts(universe);
+    std::vector<uint64_t> expected = random_sequence(universe, 3000);
+
+    std::string output;
+    Sequence::serialize(output, opts,
+                        expected.size(), expected.begin());
+    Sequence s(output.c_str(), output.size(), opts);
+
+    auto check = [&](uint64_t l, uint64_t r, uint64_t from, std::vector<uint64_t>& got) {
+        auto first = std::lower_bound(expected.begin() + from, expected.end(), l);
+        auto last = std::lower_bound(first, expected.end(), r);
+
+        BOOST_REQUIRE_EQUAL_COLLECTIONS(first, last, got.begin(), got.end());
+        return (uint64_t)(last - expected.begin());
+    };
+
+    // independent ranges, from narrow to the whole universe
+    for (uint64_t width : {1, 7, 100, 1000, 5000, 20000})
+    {
+        for (uint64_t l = 0; l + width <= universe; l += width / 2 + 1)
+        {
+            auto en = s.deserialize_at(0);
+            std::vector<uint64_t> got;
+            en.extract_range(l, l + width, got);
+
+            uint64_t pos = check(l, l + width, 0, got);
+            BOOST_REQUIRE_EQUAL(en.position(), pos);
+            if (pos < expected.size())
+                BOOST_REQUIRE_EQUAL(en.docid(), expected[pos]);
+        }
+    }
+
+    // consecutive ranges on the same enumerator
+    auto en = s.deserialize_at(0);
+    uint64_t pos = 0;
+    for (uint64_t l = 0; l < universe; l += 300)
+    {
+        std::vector<uint64_t> got;
+        en.extract_range(l, l + 150, got);
+        pos = check(l, l + 150, pos, got);
+    }
+
+    std::cout << "test_extract_range(" << name << "): ok" << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(bitmap_dense_chunks)
+{
+    // alternate dense (bitmap) and sparse (array) 2^16 chunks
+    uint64_t universe = 1 << 20;
+    options opts(universe);
+    std::vector<uint64_t> expected;
+    for (uint64_t chunk = 0; chunk < universe / bitmap_seq::chunk_size; ++chunk)
+    {
+        uint64_t n = (chunk % 2) ? 100 : 30000;
+        for (uint64_t low : random_sequence(bitmap_seq::chunk_size, n))
+            expected.push_back(chunk * bitmap_seq::chunk_size + low);
+    }
+
+    std::string output;
+    bitmap_seq::serialize(output, opts, expected.size(), expected.begin());
+    bitmap_seq s(output.c_str(), output.size(), opts);
+
+    auto en = s.deserialize_at(0);
+    BOOST_REQUIRE_EQUAL(en.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i, en.next())
+        BOOST_REQUIRE_EQUAL(en.docid(), expected[i]);
+    BOOST_REQUIRE_EQUAL(en.docid(), universe);
+
+    for (size_t i = 0; i < expected.size(); i += 997)
+    {
+        en.move(i);
+        BOOST_REQUIRE_EQUAL(en.docid(), expected[i]);
+    }
+
+    en.reset();
+    for (uint64_t bound = 0; bound < universe; bound += 313)
+    {
+        en.next_geq(bound);
+        size_t pos = std::lower_bound(expected.begin(), expected.end(), bound) - expected.begin();
+        BOOST_REQUIRE_EQUAL(en.position(), pos);
+        if (pos < expected.size())
+            BOOST_REQUIRE_EQUAL(en.docid(), expected[pos]);
+    }
+
+    en.reset();
+    std::vector<uint64_t> got;
+    en.extract_range(40000, 200000, got);
+    auto first = std::lower_bound(expected.begin(), expected.end(), 40000);
+    auto last = std::lower_bound(expected.begin(), expected.end(), 200000);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(first, last, got.begin(), got.end());
+    BOOST_REQUIRE_EQUAL(en.docid(), *last);
+
+    std::cout << "bitmap_dense_chunks: " << output.size() << " bytes for "
+              << expected.size() << " elements" << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(interval_runs)
+{
+    // runs of consecutive ids of every length around the threshold,
+    // separated by isolated residuals
+    uint64_t universe = 1 << 20;
+    options opts(universe);
+    std::vector<uint64_t> expected;
+    uint64_t docid = 3;
+    while (docid < universe - 100)
+    {
+        uint64_t run = rand() % (2 * interval_seq::min_interval_length + 4) + 1;
+        for (uint64_t i = 0; i < run; ++i)
+            expected.push_back(docid++);
+        docid += rand() % 50 + 1;
+    }
+
+    std::string output;
+    interval_seq::serialize(output, opts, expected.size(), expected.begin());
+    interval_seq s(output.c_str(), output.size(), opts);
+
+    auto en = s.deserialize_at(0);
+    BOOST_REQUIRE_EQUAL(en.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i, en.next())
+    {
+        BOOST_REQUIRE_EQUAL(en.position(), i);
+        BOOST_REQUIRE_EQUAL(en.docid(), expected[i]);
+    }
+    BOOST_REQUIRE_EQUAL(en.docid(), universe);
+
+    for (size_t i = 0; i < expected.size(); i += 37)
+    {
+        en.move(i);
+        BOOST_REQUIRE_EQUAL(en.docid(), expected[i]);
+    }
+
+    en.reset();
+    for (uint64_t bound = 0; bound < universe; bound += 29)
+    {
+        en.next_geq(bound);
+        size_t pos = std::lower_bound(expected.begin(), expected.end(), bound) - expected.begin();
+        BOOST_REQUIRE_EQUAL(en.position(), pos);
+        if (pos < expected.size())
+            BOOST_REQUIRE_EQUAL(en.docid(), expected[pos]);
+    }
+
+    en.reset();
+    std::vector<uint64_t> got;
+    en.extract_range(1000, 300000, got);
+    auto first = std::lower_bound(expected.begin(), expected.end(), 1000);
+    auto last = std::lower_bound(expected.begin(), expected.end(), 300000);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(first, last, got.begin(), got.end());
+    BOOST_REQUIRE_EQUAL(en.docid(), *last);
+
+    std::cout << "interval_runs: " << output.size() << " bytes for "
+              << expected.size() << " elements" << std::endl;
+}
+
+BOOST_AUTO_TEST_CASE(hybrid_codec_mix)
+{
+    uint64_t universe = 1 << 20;
+    options opts(universe);
+
+    // from a handful of elements up to a dense hub list
+    std::vector<std::vector<uint64_t>> lists;
+    for (uint64_t n : {3, 40, 200, 1000, 20000, 500000, 900000})
+        lists.push_back(random_sequence(universe, n));
+
+    std::string data;
+    std::vector<uint64_t> offsets;
+    for (auto& list : lists)
+    {
+        std::string output;
+        hybrid_seq::serialize(output, opts, list.size(), list.begin());
+
+        std::string candidates[hybrid_seq::num_codecs];
+        hybrid_seq::varint_type::serialize(candidates[hybrid_seq::codec_varint], opts, list.size(), list.begin());
+        hybrid_seq::optpfor_type::serialize(candidates[hybrid_seq::codec_optpfor], opts, list.size(), list.begin());
+        hybrid_seq::pef_type::serialize(candidates[hybrid_seq::codec_pef], opts, list.size(), list.begin());
+        hybrid_seq::bitmap_type::serialize(candidates[hybrid_seq::codec_bitmap], opts, list.size(), list.begin());
+        for (auto& candidate : candidates)
+            BOOST_REQUIRE_LE(output.size(), candidate.size() + 1);
+
+        offsets.push_back(data.size());
+        data.append(output);
+    }
+
+    hybrid_seq s(data.c_str(), data.size(), opts);
+    for (size_t i = 0; i < lists.size(); ++i)
+    {
+        auto en = s.deserialize_at(offsets[i]);
+        BOOST_REQUIRE_EQUAL(en.size(), lists[i].size());
+
+        auto copy = en;
+        for (size_t j = 0; j < lists[i].size(); ++j, copy.next())
+            BOOST_REQUIRE_EQUAL(copy.docid(), lists[i][j]);
+
+        std::cout << "hybrid_codec_mix: n=" << lists[i].size()
+                  << " codec=" << hybrid_seq::codec_name(en.codec()) << std::endl;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(indexed_packer_random_access)
+{
+    uint64_t universe = 20000;
+    options opts(universe);
+
+    // enough sequences to go past a few directory samples, every seventh
+    // one empty
+    std::vector<std::vector<uint64_t>> lists(2000);
+    for (size_t i = 0; i < lists.size(); ++i)
+        if (i % 7)
+            lists[i] = random_sequence(universe, 1 + i % 300);
+
+    indexed_sequence_packer packer;
+    for (auto& list : lists)
+        packer.append<block_optpfor_seq>(opts, list.size(), list.begin());
+    BOOST_REQUIRE_EQUAL(packer.size(), lists.size());
+
+    std::string data;
+    packer.encode(data);
+    packed_sequences<block_optpfor_seq> packed(data.c_str(), opts);
+    BOOST_REQUIRE_EQUAL(packed.size(), lists.size());
+    BOOST_REQUIRE_EQUAL(packed.bytes(), data.size());
+
+    std::vector<uint64_t> order(lists.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::random_shuffle(order.begin(), order.end());
+
+    for (uint64_t i : order)
+    {
+        BOOST_REQUIRE_EQUAL(packed.empty(i), lists[i].empty());
+        if (lists[i].empty())
+            continue;
+
+        auto en = packed.at(i);
+        BOOST_REQUIRE_EQUAL(en.size(), lists[i].size());
+        for (size_t j = 0; j < lists[i].size(); ++j, en.next())
+            BOOST_REQUIRE_EQUAL(en.docid(), lists[i][j]);
+    }
+}
+
 #define LOOP_BODY(R, DATA, T)                                                   \
     BOOST_AUTO_TEST_CASE(BOOST_PP_CAT(encode_decode_threaded_, T)) {            \
         test_encode_decode_threaded<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T)); \
@@ -157,3 +401,194 @@ void test_encode_decode(const char * name)
     }
     BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SEQ_TYPES);
 #undef LOOP_BODY
+
+#define LOOP_BODY(R, DATA, T)                                            \
+    BOOST_AUTO_TEST_CASE(BOOST_PP_CAT(extract_range_, T)) {              \
+        test_extract_range<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T));   \
+    }
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_SEQ_TYPES);
+#undef LOOP_BODY
+
+BOOST_AUTO_TEST_CASE(streamvbyte_block_widths)
+{
+    // every block length and every byte width, so that both the shuffle
+    // and the scalar tail are exercised
+    for (size_t n = 1; n <= streamvbyte_block::block_size; ++n)
+    {
+        std::vector<uint32_t> values(n);
+        for (size_t i = 0; i < n; ++i)
+            values[i] = uint32_t(rand()) >> (8 * (rand() % 4));
+
+        std::vector<uint8_t> encoded;
+        streamvbyte_block::encode(values.data(), 0, n, encoded);
+
+        std::vector<uint32_t> decoded(streamvbyte_block::block_size);
+        uint8_t const* end = streamvbyte_block::decode(encoded.data(), decoded.data(), 0, n);
+
+        BOOST_REQUIRE_EQUAL(end - encoded.data(), (ptrdiff_t)encoded.size());
+        BOOST_REQUIRE_EQUAL_COLLECTIONS(values.begin(), values.end(),
+                                        decoded.begin(), decoded.begin() + n);
+    }
+}
+
+template <typename Sequence>
+void benchmark_decode(const char * name,
+                            const std::vector<std::vector<uint64_t>>& lists)
+{
+    options opts(1 << 24);
+    std::string data;
+    std::vector<uint64_t> offsets;
+    uint64_t elements = 0;
+
+    for (auto& list : lists)
+    {
+        std::string output;
+        Sequence::serialize(output, opts, list.size(), list.begin());
+        offsets.push_back(data.size());
+        data.append(output);
+        elements += list.size();
+    }
+
+    Sequence s(data.c_str(), data.size(), opts);
+    uint64_t checksum = 0;
+
+    TIMEIT(std::string("Decoding ") + name + " (" + std::to_string(data.size()) + " bytes)", elements)
+    {
+        for (uint64_t offset : offsets)
+        {
+            auto en = s.deserialize_at(offset);
+            for (size_t i = 0; i < en.size(); ++i, en.next())
+                checksum += en.docid();
+        }
+    }
+
+    uint64_t expected = 0;
+    for (auto& list : lists)
+        for (uint64_t docid : list)
+            expected += docid;
+
+    BOOST_REQUIRE_EQUAL(checksum, expected);
+}
+
+#define PS_BLOCK_SEQ_TYPES (block_optpfor)(block_varint)(block_interpolative)(block_streamvbyte)
+
+BOOST_AUTO_TEST_CASE(decode_speed_block_codecs)
+{
+    // adjacency lists from sparse to dense
+    std::vector<std::vector<uint64_t>> lists;
+    for (uint64_t universe : {1 << 24, 1 << 20, 1 << 16})
+        for (size_t i = 0; i < 100; ++i)
+            lists.push_back(random_sequence(universe, 5000));
+
+#define LOOP_BODY(R, DATA, T)                                                        \
+    benchmark_decode<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T), lists);
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_BLOCK_SEQ_TYPES);
+#undef LOOP_BODY
+}
+
+template <typename Sequence>
+void benchmark_next_geq(const char * name,
+                        const std::vector<uint64_t>& list,
+                        uint64_t universe)
+{
+    options opts(universe);
+    std::string output;
+    Sequence::serialize(output, opts, list.size(), list.begin());
+    Sequence s(output.c_str(), output.size(), opts);
+
+    for (uint64_t skip : {1, 16, 256, 4096})
+    {
+        uint64_t checksum = 0, expected = 0;
+        for (size_t i = 0; i < list.size(); i += skip)
+            expected += list[i];
+
+        TIMEIT(std::string("next_geq ") + name + " skip=" + std::to_string(skip), list.size() / skip)
+        {
+            auto en = s.deserialize_at(0);
+            for (size_t i = 0; i < list.size(); i += skip)
+            {
+                en.next_geq(list[i]);
+                checksum += en.docid();
+            }
+        }
+
+        BOOST_REQUIRE_EQUAL(checksum, expected);
+    }
+}
+
+#define PS_NEXT_GEQ_SEQ_TYPES (fixed)(fixed32)(ef)(block_optpfor)
+
+BOOST_AUTO_TEST_CASE(next_geq_speed)
+{
+    uint64_t universe = 1 << 24;
+    std::vector<uint64_t> list = random_sequence(universe, 1 << 20);
+
+#define LOOP_BODY(R, DATA, T)                                                        \
+    benchmark_next_geq<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T), list, universe);
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_NEXT_GEQ_SEQ_TYPES);
+#undef LOOP_BODY
+}
+
+#define PS_EF_SEQ_TYPES (ef)(opt)(native_ef)(native_pef)
+
+BOOST_AUTO_TEST_CASE(elias_fano_head_to_head)
+{
+    std::vector<std::vector<uint64_t>> lists;
+    for (uint64_t universe : {1 << 24, 1 << 20, 1 << 16})
+        for (size_t i = 0; i < 100; ++i)
+            lists.push_back(random_sequence(universe, 5000));
+
+    uint64_t universe = 1 << 24;
+    std::vector<uint64_t> list = random_sequence(universe, 1 << 20);
+
+#define LOOP_BODY(R, DATA, T)                                                        \
+    benchmark_decode<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T), lists);              \
+    benchmark_next_geq<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T), list, universe);
+    BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_EF_SEQ_TYPES);
+#undef LOOP_BODY
+}
+
+template <typename Sequence>
+void benchmark_next_geq_by_length(const char * name, uint64_t n)
+{
+    uint64_t universe = 16 * n;
+    std::vector<uint64_t> list = random_sequence(universe, n);
+    options opts(universe);
+    std::string output;
+    Sequence::serialize(output, opts, list.size(), list.begin());
+    Sequence s(output.c_str(), output.size(), opts);
+
+    // every query starts from a fresh enumerator and jumps to a random
+    // target, as when probing a hub list
+    std::vector<uint64_t> targets = random_sequence(list.back() - list.front() + 1, 10000);
+    for (auto& target : targets)
+        target += list.front();
+    std::random_shuffle(targets.begin(), targets.end());
+
+    uint64_t checksum = 0, expected = 0;
+    for (uint64_t target : targets)
+        expected += *std::lower_bound(list.begin(), list.end(), target);
+
+    TIMEIT(std::string("next_geq ") + name + " n=" + std::to_string(n), targets.size())
+    {
+        for (uint64_t target : targets)
+        {
+            auto en = s.deserialize_at(0);
+            en.next_geq(target);
+            checksum += en.docid();
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(checksum, expected);
+}
+
+BOOST_AUTO_TEST_CASE(next_geq_latency_by_length)
+{
+    for (uint64_t n : {1 << 10, 1 << 13, 1 << 16, 1 << 19, 1 << 22})
+    {
+#define LOOP_BODY(R, DATA, T)                                                        \
+        benchmark_next_geq_by_length<BOOST_PP_CAT(T, _seq)>(BOOST_STRINGIZE(T), n);
+        BOOST_PP_SEQ_FOR_EACH(LOOP_BODY, _, PS_BLOCK_SEQ_TYPES);
+#undef LOOP_BODY
+    }
+}
@@ -9,7 +9,7 @@ RESULTSDIR=${3:-datasets/results/encodings}
 BUCKETS=$(seq 0 9)
 QUERYLENGTHS=$(seq 1 5)
 DICTIONARIES=("permuterm")
-ENCODINGS=("block_varint" "block_interpolative" "block_optpfor" "ef")
+ENCODINGS=("block_varint" "block_interpolative" "block_optpfor" "block_streamvbyte" "ef" "bitmap" "hybrid")
 
 build_and_query()
 {